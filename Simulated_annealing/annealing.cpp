@@ -7,6 +7,12 @@
  */
 
 #include "annealing.h"
+#include "domain_decomposition.h"
+#include "hilbert.h"
+#include "local_search.h"
+#include "neighbours.h"
+#include "rejection_free.h"
+#include "speculative.h"
 
 
 // RandomDoubleGenerator
@@ -27,6 +33,14 @@ RandomDoubleGenerator::RandomDoubleGenerator(double from, double to, double mean
     normalDistribution = normal_distribution(mean, sd);
 }
 
+RandomDoubleGenerator::RandomDoubleGenerator(double from, double to, double mean, double sd,
+                                             mt19937::result_type seed):
+
+        gen{mt19937(seed)},
+        uniformDistribution{uniform_real_distribution(from, to)},
+        normalDistribution{normal_distribution(mean, sd)}
+{}
+
 double RandomDoubleGenerator::getRandomUniform() {
     return uniformDistribution(gen);
 }
@@ -53,10 +67,20 @@ RandomIntGenerator::RandomIntGenerator(int from, int to) {
     uniformIntDistribution = uniform_int_distribution(from, to);
 }
 
+RandomIntGenerator::RandomIntGenerator(int from, int to, mt19937::result_type seed):
+
+        gen{mt19937(seed)},
+        uniformIntDistribution{uniform_int_distribution(from, to)}
+{}
+
 int RandomIntGenerator::getRandomUniform() {
     return uniformIntDistribution(gen);
 }
 
+int RandomIntGenerator::getRandomUniform(int from, int to) {
+    return uniform_int_distribution<int>(from, to)(gen);
+}
+
 
 // Point
 
@@ -73,56 +97,442 @@ double Point::getDistanceBetween(const Point &pA, const Point &pB) {
 }
 
 
+// Instance
+
+Instance::Instance(const vector<Point>& points):
+
+        cities{vector<Point>()},
+        compactCities{vector<CompactPoint>()},
+        compactCitiesBuilt{},
+        inputNumbers{vector<int>()},
+        edgeLength{1.},
+        neighbourLists{}
+{
+    vector<int> curveOrder = hilbertOrder(points);
+    cities = permutePoints(points, curveOrder);
+    inputNumbers = inverseOrder(curveOrder);
+    if(cities.empty())
+        return;
+
+    double minX = cities[0].getX(), maxX = minX;
+    double minY = cities[0].getY(), maxY = minY;
+    for(const auto& p: cities) {
+        minX = min(minX, p.getX());
+        maxX = max(maxX, p.getX());
+        minY = min(minY, p.getY());
+        maxY = max(maxY, p.getY());
+    }
+    double area = (maxX - minX) * (maxY - minY);
+    if(area > 0.)
+        edgeLength = 0.7124 * sqrt(area / (double) cities.size());
+}
+
+void Instance::prepareCompactCities() const {
+    call_once(compactCitiesBuilt, [this]() {
+        if(cities.empty())
+            return;
+        // Recentring keeps the float coordinates small, so they lose precision only relative to the extent
+        double minX = cities[0].getX(), maxX = minX;
+        double minY = cities[0].getY(), maxY = minY;
+        for(const auto& p: cities) {
+            minX = min(minX, p.getX());
+            maxX = max(maxX, p.getX());
+            minY = min(minY, p.getY());
+            maxY = max(maxY, p.getY());
+        }
+        double centreX = (minX + maxX) / 2., centreY = (minY + maxY) / 2.;
+        compactCities.reserve(cities.size());
+        for(const auto& p: cities)
+            compactCities.push_back(CompactPoint{(float) (p.getX() - centreX), (float) (p.getY() - centreY)});
+    });
+}
+
+shared_ptr<const NeighbourLists> Instance::getNeighbourLists(int neighboursNumber, DistanceMetric metric) const {
+    lock_guard<mutex> lock(neighboursMutex);
+    for(const auto& entry: neighbourLists)
+        if(get<0>(entry) == neighboursNumber && get<1>(entry) == metric)
+            return get<2>(entry);
+    auto lists = make_shared<const NeighbourLists>(cities, neighboursNumber, metric);
+    neighbourLists.emplace_back(neighboursNumber, metric, lists);
+    return lists;
+}
+
+
 // PointGraph
 
 void PointGraph::initGraphUniform(RandomDoubleGenerator& randGenX, RandomDoubleGenerator& randGenY, size_t size) {
-    points.clear();
-    _size = 0;
-    for(int i = 0; i < size; i++) {
+    vector<Point> points;
+    for(size_t i = 0; i < size; i++)
         points.emplace_back(randGenX.getRandomUniform(), randGenY.getRandomUniform());
-        _size++;
-    }
-    randIndexGen = RandomIntGenerator(0, (int) _size - 1);
+    setCities(points);
 }
 
 void PointGraph::initGraphNormal(RandomDoubleGenerator &randGenX, RandomDoubleGenerator &randGenY, size_t size) {
-    points.clear();
-    _size = 0;
-    for(int i = 0; i < size; i++) {
+    vector<Point> points;
+    for(size_t i = 0; i < size; i++)
         points.emplace_back(randGenX.getRandomNormal(), randGenY.getRandomNormal());
-        _size++;
+    setCities(points);
+}
+
+void PointGraph::initGraphClustered(RandomDoubleGenerator &randGenX, RandomDoubleGenerator &randGenY, size_t size,
+                                    size_t clustersNumber) {
+    vector<pair<double, double>> centres;
+    for(size_t c = 0; c < max<size_t>(clustersNumber, 1); c++)
+        centres.emplace_back(randGenX.getRandomUniform(), randGenY.getRandomUniform());
+
+    vector<Point> points;
+    for(size_t i = 0; i < size; i++) {
+        const auto& centre = centres[i % centres.size()];
+        points.emplace_back(centre.first + randGenX.getRandomNormal(), centre.second + randGenY.getRandomNormal());
     }
+    setCities(points);
+}
+
+void PointGraph::setCities(const vector<Point>& points) {
+    instance = make_shared<const Instance>(points);
+    order = instance->getInputNumbers();
+    _size = order.size();
     randIndexGen = RandomIntGenerator(0, (int) _size - 1);
+    totalDistanceValid = false;
+    if(precision == Precision::Single)
+        instance->prepareCompactCities();
+}
+
+void PointGraph::sortAlongHilbertCurve() {
+    // The cities are already numbered along the curve
+    order = identityOrder(_size);
+    totalDistanceValid = false;
+}
+
+vector<Point> PointGraph::getPoints() const {
+    vector<Point> points;
+    points.reserve(_size);
+    for(int city: order)
+        points.push_back(instance->getCity(city));
+    return points;
 }
 
 double PointGraph::getTotalDistance() {
+    if(!totalDistanceValid) {
+        double recomputed = computeTotalDistance();
+        totalDistance = CompensatedSum(recomputed);
+        roundedTotalDistance = llround(recomputed);
+        totalDistanceValid = true;
+    }
+#ifdef VERIFY_CACHED_LENGTH
+    verifyTotalDistance();
+#endif
+    return metric == DistanceMetric::Rounded ? (double) roundedTotalDistance : totalDistance.value();
+}
+
+double PointGraph::getPathLength(size_t from, size_t to) const {
+    if(metric == DistanceMetric::Rounded) {
+        long long acc = 0;
+        for(size_t i = from; i < to; i++)
+            acc += (long long) distance(i, i == 0 ? _size - 1 : i - 1);
+        return (double) acc;
+    }
+    double acc = 0.;
+    for(size_t i = from; i < to; i++)
+        acc += distance(i, i == 0 ? _size - 1 : i - 1);
+    return acc;
+}
+
+double PointGraph::computeTotalDistance(int threads) const {
     if(_size == 0 || _size == 1)
         return 0.;
     else if(_size == 2)
-        return points.front().getDistanceTo(points.back());
+        return distance(0, 1);
+
+    // Splitting pays off only for long tours
+    threads = max(1, min(threads, (int) (_size / 65536)));
+    if(threads > 1) {
+        vector<double> partial(threads, 0.);
+        vector<thread> workers;
+        for(int t = 0; t < threads; t++)
+            workers.emplace_back([this, &partial, t, threads]() {
+                partial[t] = getPathLength(_size * t / threads, _size * (t + 1) / threads);
+            });
+        for(auto& worker: workers)
+            worker.join();
+        CompensatedSum acc;
+        for(double part: partial)
+            acc.add(part);
+        return acc.value();
+    }
+    return getPathLength(0, _size);
+}
 
+double PointGraph::resyncTotalDistance(int threads) {
+    double recomputed = computeTotalDistance(threads);
+    double drift = totalDistanceValid ?
+            abs((metric == DistanceMetric::Rounded ? (double) roundedTotalDistance : totalDistance.value()) - recomputed) :
+            0.;
+    totalDistance = CompensatedSum(recomputed);
+    roundedTotalDistance = llround(recomputed);
+    totalDistanceValid = true;
+    return drift;
+}
+
+void PointGraph::verifyTotalDistance() const {
+    double recomputed = computeTotalDistance();
+    double cached = metric == DistanceMetric::Rounded ? (double) roundedTotalDistance : totalDistance.value();
+    // Rounded lengths are exact, Euclidean ones accumulate rounding errors of the deltas
+    double tolerance = metric == DistanceMetric::Rounded ? 0. : 1e-6 * max(1., recomputed);
+    if(abs(recomputed - cached) > tolerance) {
+        cerr << "Cached tour length " << cached << " differs from recomputed " << recomputed << endl;
+        abort();
+    }
+}
+
+double PointGraph::getEdgesLength(size_t idxA, size_t idxB) const {
+    // Edges leaving positions idxA - 1, idxA, idxB - 1 and idxB, each counted once
+    size_t edges[] = {idxA == 0 ? _size - 1 : idxA - 1, idxA, idxB == 0 ? _size - 1 : idxB - 1, idxB};
     double acc = 0.;
-    auto prevP = points.back();
-    for(auto p: points) {
-        acc += p.getDistanceTo(prevP);
-        prevP = p;
+    for(int e = 0; e < 4; e++) {
+        bool repeated = false;
+        for(int prev = 0; prev < e; prev++)
+            repeated = repeated || edges[prev] == edges[e];
+        if(!repeated)
+            acc += distance(edges[e], edges[e] == _size - 1 ? 0 : edges[e] + 1);
     }
     return acc;
 }
 
+size_t PointGraph::randomPosition() {
+    if(windowLength == 0)
+        return randIndexGen.getRandomUniform();
+    return (windowStart + randIndexGen.getRandomUniform(0, (int) windowLength - 1)) % _size;
+}
+
+size_t PointGraph::randomSegmentStart(size_t length) {
+    if(windowLength == 0)
+        return randIndexGen.getRandomUniform(0, (int) (_size - length));
+    for(int attempt = 0; attempt < PointGraph::maxWindowDraws; attempt++) {
+        size_t first = randomPosition();
+        if(first <= _size - length)
+            return first;
+    }
+    // The window barely reaches the valid starts, fall back to the whole range
+    return randIndexGen.getRandomUniform(0, (int) (_size - length));
+}
+
+size_t PointGraph::randomOffset(size_t count) {
+    if(moveRange == 0 || 2 * moveRange >= count)
+        return randIndexGen.getRandomUniform(0, (int) count - 1);
+    size_t offset = randIndexGen.getRandomUniform(0, 2 * (int) moveRange - 1);
+    return offset < moveRange ? offset : count - 2 * moveRange + offset;
+}
+
 void PointGraph::consecutiveSwap() {
-    int idxA = randIndexGen.getRandomUniform();
+    int idxA = (int) randomPosition();
     int idxB = idxA == _size - 1 ? 0 : idxA + 1;
-    swap(points[idxA], points[idxB]);
+    if(_size < 3) {
+        swapPositions(idxA, idxB);
+        return;
+    }
+    double before = getEdgesLength(idxA, idxB);
+    swapPositions(idxA, idxB);
+    addToTotalDistance(getEdgesLength(idxA, idxB) - before);
 }
 
 void PointGraph::arbitrarySwap() {
-    int idxA = randIndexGen.getRandomUniform();
-    int idxB = randIndexGen.getRandomUniform();
-    while(idxA == idxB)
-        idxB = randIndexGen.getRandomUniform();
+    if(_size < 2)
+        return;
+    size_t idxA = randomPosition();
+    size_t idxB = (idxA + 1 + randomOffset(_size - 1)) % _size;
+
+    if(_size < 3) {
+        swapPositions(idxA, idxB);
+        return;
+    }
+    double before = getEdgesLength(idxA, idxB);
+    swapPositions(idxA, idxB);
+    addToTotalDistance(getEdgesLength(idxA, idxB) - before);
+}
+
+SegmentMove PointGraph::randomOrOpt() {
+    if(_size < 4)
+        return SegmentMove{0, 0, 0, false, 0.};  // No valid relocation, segment "inserted" into itself
+
+    size_t length = randIndexGen.getRandomUniform(1, (int) min<size_t>(3, _size - 3));
+    size_t first = randomSegmentStart(length);
+    size_t last = first + length - 1;
+    size_t after = (last + 1 + randomOffset(_size - length - 1)) % _size;
+
+    double deltaForward = getSegmentMoveDelta(first, last, after, false);
+    double deltaReversed = getSegmentMoveDelta(first, last, after, true);
+    if(length > 1 && deltaReversed < deltaForward)
+        return SegmentMove{first, last, after, true, deltaReversed};
+    return SegmentMove{first, last, after, false, deltaForward};
+}
+
+SegmentMove PointGraph::randomSegmentInsertion() {
+    if(_size < 4)
+        return SegmentMove{0, 0, 0, false, 0.};
 
-    swap(points[idxA], points[idxB]);
+    size_t maxLength = moveRange == 0 ? _size - 3 : min(_size - 3, moveRange);
+    size_t length = randIndexGen.getRandomUniform(1, (int) maxLength);
+    size_t first = randomSegmentStart(length);
+    size_t last = first + length - 1;
+    size_t after = (last + 1 + randomOffset(_size - length - 1)) % _size;
+    return SegmentMove{first, last, after, false, getSegmentMoveDelta(first, last, after, false)};
+}
+
+double PointGraph::getSegmentMoveDelta(size_t first, size_t last, size_t after, bool reversed) const {
+    size_t prev = first == 0 ? _size - 1 : first - 1;
+    size_t next = last == _size - 1 ? 0 : last + 1;
+    size_t segFirst = first;
+    size_t segLast = last;
+    size_t insA = after;
+    size_t insB = after == _size - 1 ? 0 : after + 1;
+
+    double removed = distance(prev, segFirst) + distance(segLast, next) + distance(insA, insB);
+    double added = distance(prev, next) + (reversed ?
+            distance(insA, segLast) + distance(segFirst, insB) :
+            distance(insA, segFirst) + distance(segLast, insB));
+    return added - removed;
+}
+
+// Deltas of swaps whose neighbourhoods were gathered into x[slot][i], y[slot][i], with slots
+// 0..5 = a - 1, a, a + 1, b - 1, b, b + 1. Branch-free, so the loop vectorises.
+template<typename T, bool rounded>
+static void evaluateSwapBatch(const T (&x)[6][PointGraph::maxBatchSize], const T (&y)[6][PointGraph::maxBatchSize],
+                              int count, double* deltas) {
+    auto edge = [&](int from, int to, int i) {
+        T dx = x[from][i] - x[to][i], dy = y[from][i] - y[to][i];
+        T d = sqrt(dx * dx + dy * dy);
+        return rounded ? (double) floor(d + (T) 0.5) : (double) d;
+    };
+    for(int i = 0; i < count; i++) {
+        double before = edge(0, 1, i) + edge(1, 2, i) + edge(3, 4, i) + edge(4, 5, i);
+        double after = edge(0, 4, i) + edge(4, 2, i) + edge(3, 1, i) + edge(1, 5, i);
+        deltas[i] = after - before;
+    }
+}
+
+bool PointGraph::randomSwapBatch(SwapMove* moves, int count) {
+    if(_size < 5)
+        return false;
+    count = min(count, maxBatchSize);
+
+    size_t positions[6][maxBatchSize];
+    for(int i = 0; i < count; i++) {
+        size_t idxA = randomPosition();
+        size_t idxB = (idxA + 2 + randomOffset(_size - 3)) % _size;
+        moves[i].idxA = idxA;
+        moves[i].idxB = idxB;
+        positions[0][i] = idxA == 0 ? _size - 1 : idxA - 1;
+        positions[1][i] = idxA;
+        positions[2][i] = idxA == _size - 1 ? 0 : idxA + 1;
+        positions[3][i] = idxB == 0 ? _size - 1 : idxB - 1;
+        positions[4][i] = idxB;
+        positions[5][i] = idxB == _size - 1 ? 0 : idxB + 1;
+    }
+
+    double deltas[maxBatchSize];
+    bool rounded = metric == DistanceMetric::Rounded;
+    if(precision == Precision::Single) {
+        float x[6][maxBatchSize], y[6][maxBatchSize];
+        for(int slot = 0; slot < 6; slot++)
+            for(int i = 0; i < count; i++) {
+                x[slot][i] = instance->getCompactCity(order[positions[slot][i]]).x;
+                y[slot][i] = instance->getCompactCity(order[positions[slot][i]]).y;
+            }
+        rounded ? evaluateSwapBatch<float, true>(x, y, count, deltas) : evaluateSwapBatch<float, false>(x, y, count, deltas);
+    }
+    else {
+        double x[6][maxBatchSize], y[6][maxBatchSize];
+        for(int slot = 0; slot < 6; slot++)
+            for(int i = 0; i < count; i++) {
+                const Point& city = instance->getCity(order[positions[slot][i]]);
+                x[slot][i] = city.getX();
+                y[slot][i] = city.getY();
+            }
+        rounded ? evaluateSwapBatch<double, true>(x, y, count, deltas) : evaluateSwapBatch<double, false>(x, y, count, deltas);
+    }
+
+    for(int i = 0; i < count; i++)
+        moves[i].delta = deltas[i];
+    return true;
+}
+
+void PointGraph::applySwap(const SwapMove& move) {
+    swapPositions(move.idxA, move.idxB);
+    addToTotalDistance(move.delta);
+}
+
+// Applies the relocation to a sequence kept in tour order, returns false if the move changes nothing
+template<typename T>
+static bool permuteSegment(vector<T>& sequence, const SegmentMove& move) {
+    size_t length = move.last - move.first + 1;
+    size_t newFirst;
+    if(move.after > move.last) {
+        rotate(sequence.begin() + (long) move.first, sequence.begin() + (long) move.last + 1,
+               sequence.begin() + (long) move.after + 1);
+        newFirst = move.after + 1 - length;
+    }
+    else if(move.after + 1 < move.first) {
+        rotate(sequence.begin() + (long) move.after + 1, sequence.begin() + (long) move.first,
+               sequence.begin() + (long) move.last + 1);
+        newFirst = move.after + 1;
+    }
+    else
+        return false;
+
+    if(move.reversed)
+        reverse(sequence.begin() + (long) newFirst, sequence.begin() + (long) (newFirst + length));
+    return true;
+}
+
+void PointGraph::moveSegment(const SegmentMove& move) {
+    if(permuteSegment(order, move))
+        addToTotalDistance(move.delta);
+}
+
+TwoOptMove PointGraph::randomTwoOpt() {
+    if(_size < 5)
+        return TwoOptMove{0, 0, 0.};
+
+    size_t first = randomPosition();
+    size_t length = 2 + randomOffset(_size - 3);
+    return TwoOptMove{first, length, getTwoOptDelta(first, length)};
+}
+
+double PointGraph::getTwoOptDelta(size_t first, size_t length) const {
+    size_t last = (first + length - 1) % _size;
+    size_t prev = first == 0 ? _size - 1 : first - 1;
+    size_t next = last == _size - 1 ? 0 : last + 1;
+    return distance(prev, last) + distance(first, next) - distance(prev, first) - distance(last, next);
+}
+
+// Reverses the cyclic range of length positions starting at from
+template<typename T>
+static void reverseCyclic(vector<T>& sequence, size_t from, size_t length) {
+    size_t n = sequence.size();
+    size_t to = (from + length - 1) % n;
+    if(from <= to) {
+        reverse(sequence.begin() + (long) from, sequence.begin() + (long) to + 1);
+        return;
+    }
+    for(size_t s = 0; s < length / 2; s++) {
+        swap(sequence[from], sequence[to]);
+        from = from == n - 1 ? 0 : from + 1;
+        to = to == 0 ? n - 1 : to - 1;
+    }
+}
+
+void PointGraph::reverseSegment(const TwoOptMove& move) {
+    if(move.length < 2)
+        return;
+
+    size_t from = move.first, length = move.length;
+    if(2 * length > _size) {
+        from = (move.first + length) % _size;
+        length = _size - length;
+    }
+    reverseCyclic(order, from, length);
+    addToTotalDistance(move.delta);
 }
 
 PointGraph &PointGraph::operator=(const PointGraph &other) {
@@ -130,7 +540,17 @@ PointGraph &PointGraph::operator=(const PointGraph &other) {
         return *this;
     _size = other._size;
     randIndexGen = RandomIntGenerator(0, (int) other.size() - 1);
-    points = other.points;
+    instance = other.instance;
+    order = other.order;
+    representation = other.representation;
+    metric = other.metric;
+    precision = other.precision;
+    totalDistance = other.totalDistance;
+    roundedTotalDistance = other.roundedTotalDistance;
+    totalDistanceValid = other.totalDistanceValid;
+    moveRange = other.moveRange;
+    windowStart = other.windowStart;
+    windowLength = other.windowLength;
     return *this;
 }
 
@@ -139,8 +559,19 @@ PointGraph &PointGraph::operator=(PointGraph&& other) noexcept {
         return *this;
     _size = other._size;
     randIndexGen = RandomIntGenerator(0, (int) other.size() - 1);
-    points = move(other.points);
+    instance = other.instance;
+    order = move(other.order);
+    representation = other.representation;
+    metric = other.metric;
+    precision = other.precision;
+    totalDistance = other.totalDistance;
+    roundedTotalDistance = other.roundedTotalDistance;
+    totalDistanceValid = other.totalDistanceValid;
+    moveRange = other.moveRange;
+    windowStart = other.windowStart;
+    windowLength = other.windowLength;
     other._size = 0;
+    other.totalDistanceValid = false;
     return *this;
 }
 
@@ -185,7 +616,29 @@ shared_ptr<PointGraph> SimulatedAnnealingTSP::getNextState() {
             nextState->arbitrarySwap();
             return nextState;
         }
-        case NextState::Mixed: {
+        case NextState::OrOpt: {
+            shared_ptr<PointGraph> nextState = make_shared<PointGraph>(*currentState);
+            nextState->moveSegment(nextState->randomOrOpt());
+            return nextState;
+        }
+        case NextState::SegmentInsertion: {
+            shared_ptr<PointGraph> nextState = make_shared<PointGraph>(*currentState);
+            nextState->moveSegment(nextState->randomSegmentInsertion());
+            return nextState;
+        }
+        case NextState::TwoOpt: {
+            shared_ptr<PointGraph> nextState = make_shared<PointGraph>(*currentState);
+            nextState->reverseSegment(nextState->randomTwoOpt());
+            return nextState;
+        }
+        case NextState::Adaptive: {
+            // Only used for tours too small for the adaptive operators
+            shared_ptr<PointGraph> nextState = make_shared<PointGraph>(*currentState);
+            nextState->consecutiveSwap();
+            return nextState;
+        }
+        case NextState::Mixed:
+        case NextState::MixedBatch: {
             shared_ptr<PointGraph> nextState = make_shared<PointGraph>(*currentState);
             for(int i = 0; i < SimulatedAnnealingTSP::mixedAttemptsNumber; i++) {
                 nextState->arbitrarySwap();
@@ -204,124 +657,613 @@ void SimulatedAnnealingTSP::attemptAccepting(shared_ptr<PointGraph> &candidate)
     double candidateE = getEnergy(candidate);
     if(candidateE < E) {
         E = candidateE;
+        dropJournal();
         currentState = move(candidate);
         updateBest();
     }
     else if(T > 0.) {
-        if(getRandomProbability() < acceptanceProbability(candidateE)) {
+        if(candidateE < acceptanceLimit()) {
             E = candidateE;
+            dropJournal();
             currentState = move(candidate);
         }
     }
 }
 
-double SimulatedAnnealingTSP::acceptanceProbability(double candidateE) const {
-    return (T == 0.) ? 0. : exp(-abs(candidateE - E) / T);
+void SimulatedAnnealingTSP::attemptAccepting(const SegmentMove& move) {
+    double candidateE = E + move.delta;
+    if(candidateE < E) {
+        currentState->moveSegment(move);
+        E = getEnergy(currentState);
+        journalMove(move);
+        updateBest();
+    }
+    else if(T > 0.) {
+        if(candidateE < acceptanceLimit()) {
+            currentState->moveSegment(move);
+            E = getEnergy(currentState);
+            journalMove(move);
+        }
+    }
+}
+
+void SimulatedAnnealingTSP::attemptAccepting(const SwapMove& move) {
+    double candidateE = E + move.delta;
+    if(candidateE < E) {
+        currentState->applySwap(move);
+        E = getEnergy(currentState);
+        journalMove(move);
+        updateBest();
+    }
+    else if(T > 0.) {
+        if(candidateE < acceptanceLimit()) {
+            currentState->applySwap(move);
+            E = getEnergy(currentState);
+            journalMove(move);
+        }
+    }
+}
+
+void SimulatedAnnealingTSP::attemptAccepting(const TwoOptMove& move) {
+    double candidateE = E + move.delta;
+    if(candidateE < E) {
+        currentState->reverseSegment(move);
+        E = getEnergy(currentState);
+        journalMove(move);
+        updateBest();
+    }
+    else if(T > 0.) {
+        if(candidateE < acceptanceLimit()) {
+            currentState->reverseSegment(move);
+            E = getEnergy(currentState);
+            journalMove(move);
+        }
+    }
+}
+
+void SimulatedAnnealingTSP::attemptAcceptingBatch() {
+    SwapMove moves[PointGraph::maxBatchSize];
+    int count = min(SimulatedAnnealingTSP::mixedAttemptsNumber, PointGraph::maxBatchSize);
+    if(!currentState->randomSwapBatch(moves, count)) {
+        shared_ptr<PointGraph> candidate = getNextState();
+        attemptAccepting(candidate);
+        return;
+    }
+
+    int best = 0;
+    for(int i = 1; i < count; i++)
+        if(moves[i].delta < moves[best].delta)
+            best = i;
+    if(moves[best].delta < 0.) {
+        currentState->applySwap(moves[best]);
+        E = getEnergy(currentState);
+        journalMove(moves[best]);
+        updateBest();
+        return;
+    }
+    if(T <= 0.)
+        return;
+
+    // One limit serves the whole batch, for Metropolis it shares a single random number
+    double threshold = acceptanceLimit() - E;
+    for(int i = 0; i < count; i++)
+        if(moves[i].delta < threshold) {
+            currentState->applySwap(moves[i]);
+            E = getEnergy(currentState);
+            journalMove(moves[i]);
+            return;
+        }
+}
+
+size_t SimulatedAnnealingTSP::getScaledMoveRange(size_t n) const {
+    // An accepted move changes the length by about T, so its endpoints lie within about T of each other.
+    // In a tour that is already good at that scale, such cities are about (T / l)^2 positions apart.
+    double reach = max(0., T) / moveRangeEdge;
+    double scaled = ceil(SimulatedAnnealingTSP::moveRangeScale * reach * reach);
+    return max(minMoveRange, (size_t) min(scaled, (double) n));
+}
+
+void SimulatedAnnealingTSP::applyMoveRange() {
+    size_t n = currentState->size();
+    if(minMoveRange == 0 || n == 0)
+        return;
+
+    size_t range = getScaledMoveRange(n);
+    if(moveWindow > 0 && ++moveWindowMoves >= moveWindow) {
+        moveWindowStart = (moveWindowStart + max<size_t>(1, moveWindow / 2)) % n;
+        moveWindowMoves = 0;
+    }
+    currentState->setMoveRange(range, moveWindowStart, moveWindow);
+}
+
+void SimulatedAnnealingTSP::setMoveRange(size_t minRange, size_t window) {
+    minMoveRange = minRange;
+    moveWindow = window;
+    moveRangeEdge = currentState->getInstance()->getEdgeLength();
+}
+
+void SimulatedAnnealingTSP::makeMove() {
+    applyMoveRange();
+    switch(nextStateChoice) {
+        // Segment moves are evaluated by their delta and applied in place
+        case NextState::OrOpt:
+            attemptAccepting(currentState->randomOrOpt());
+            break;
+        case NextState::SegmentInsertion:
+            attemptAccepting(currentState->randomSegmentInsertion());
+            break;
+        case NextState::TwoOpt:
+            attemptAccepting(currentState->randomTwoOpt());
+            break;
+        case NextState::MixedBatch:
+            attemptAcceptingBatch();
+            break;
+        case NextState::Adaptive:
+            makeAdaptiveMove();
+            break;
+        default: {
+            shared_ptr<PointGraph> candidate = getNextState();
+            attemptAccepting(candidate);
+        }
+    }
+
+    if(acceptanceChoice == Acceptance::LateAcceptance) {
+        lateEnergies[lateIndex] = E;
+        lateIndex = lateIndex + 1 == (int) lateEnergies.size() ? 0 : lateIndex + 1;
+    }
+}
+
+int SimulatedAnnealingTSP::getTemperatureBand() const {
+    if(T <= 0.)
+        return SimulatedAnnealingTSP::temperatureBands - 1;
+    int band = (int) floor(log2(SimulatedAnnealingTSP::initialT / T));
+    return max(0, min(band, SimulatedAnnealingTSP::temperatureBands - 1));
+}
+
+void SimulatedAnnealingTSP::updateOperatorProbabilities() {
+    double rates[SimulatedAnnealingTSP::operatorsNumber];
+    double total = 0.;
+    for(int o = 0; o < SimulatedAnnealingTSP::operatorsNumber; o++) {
+        rates[o] = operatorStats[operatorBand * SimulatedAnnealingTSP::operatorsNumber + o].getRate();
+        total += rates[o];
+    }
+
+    double share = 1. - SimulatedAnnealingTSP::operatorsNumber * SimulatedAnnealingTSP::minOperatorProbability;
+    for(int o = 0; o < SimulatedAnnealingTSP::operatorsNumber; o++)
+        operatorProbabilities[o] = total > 0. ?
+                SimulatedAnnealingTSP::minOperatorProbability + share * rates[o] / total :
+                1. / SimulatedAnnealingTSP::operatorsNumber;
+}
+
+void SimulatedAnnealingTSP::makeAdaptiveMove() {
+    if(currentState->size() < 5) {
+        shared_ptr<PointGraph> candidate = getNextState();
+        attemptAccepting(candidate);
+        return;
+    }
+
+    int band = getTemperatureBand();
+    if(band != operatorBand || adaptiveMoves % SimulatedAnnealingTSP::operatorUpdateInterval == 0) {
+        operatorBand = band;
+        updateOperatorProbabilities();
+    }
+    adaptiveMoves++;
+
+    double u = getRandomProbability();
+    int o = 0;
+    while(o < SimulatedAnnealingTSP::operatorsNumber - 1 && u >= operatorProbabilities[o]) {
+        u -= operatorProbabilities[o];
+        o++;
+    }
+
+    // Reading the clock costs about as much as a move, so only every few proposals are timed
+    OperatorStats& stats = operatorStats[band * SimulatedAnnealingTSP::operatorsNumber + o];
+    bool timed = stats.proposals % SimulatedAnnealingTSP::operatorTimingInterval == 0;
+    chrono::steady_clock::time_point start;
+    if(timed)
+        start = chrono::steady_clock::now();
+
+    double previousE = E;
+    switch((MoveOperator) o) {
+        case MoveOperator::Swap: {
+            SwapMove move{};
+            currentState->randomSwapBatch(&move, 1);
+            attemptAccepting(move);
+            break;
+        }
+        case MoveOperator::TwoOpt:
+            attemptAccepting(currentState->randomTwoOpt());
+            break;
+        case MoveOperator::OrOpt:
+            attemptAccepting(currentState->randomOrOpt());
+            break;
+        case MoveOperator::SegmentInsertion:
+            attemptAccepting(currentState->randomSegmentInsertion());
+            break;
+    }
+
+    if(timed) {
+        stats.seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        stats.timed++;
+    }
+    stats.proposals++;
+    if(E != previousE)
+        stats.accepted++;
+    if(E < previousE)
+        stats.improvement += previousE - E;
+}
+
+double SimulatedAnnealingTSP::acceptanceLimit() {
+    switch(acceptanceChoice) {
+        case Acceptance::Metropolis:
+            // u < exp(-delta / T) is delta < -T ln u
+            return E - T * log(getRandomProbability());
+        case Acceptance::ThresholdAccepting:
+            return E + T;
+        case Acceptance::GreatDeluge: {
+            double level = T / SimulatedAnnealingTSP::initialT;
+            return level * getEnergy(initialState) + (1. - level) * bestE;
+        }
+        case Acceptance::RecordToRecord:
+            return bestE + T;
+        case Acceptance::LateAcceptance:
+            return lateEnergies[lateIndex];
+    }
+    return E;
 }
 
 void SimulatedAnnealingTSP::updateBest() {
     if(E < bestE) {
         bestE = E;
-        bestState = make_shared<PointGraph>(*currentState);
+        if(journalBase) {
+            bestJournalLength = journal.size();
+            bestPending = true;
+        }
+        else {
+            bestState = make_shared<PointGraph>(*currentState);
+            journalBase = bestState;
+            journal.clear();
+            bestPending = false;
+        }
         iterationsSinceBest = 0;
     }
 }
 
+// Replays a journal entry on a copy of the state it was applied to
+static void applyJournalEntry(PointGraph& graph, const JournalEntry& entry) {
+    if(holds_alternative<SegmentMove>(entry))
+        graph.moveSegment(get<SegmentMove>(entry));
+    else if(holds_alternative<SwapMove>(entry))
+        graph.applySwap(get<SwapMove>(entry));
+    else
+        graph.reverseSegment(get<TwoOptMove>(entry));
+}
+
+void SimulatedAnnealingTSP::journalMove(const JournalEntry& entry) {
+    if(!journalBase)
+        return;
+    journal.push_back(entry);
+
+    // Rebasing copies the tour once per n / journalFraction moves, so it costs O(1) per move
+    if(journal.size() > max(SimulatedAnnealingTSP::minJournalLength,
+                            currentState->size() / SimulatedAnnealingTSP::journalFraction)) {
+        materialiseBest();
+        journalBase = make_shared<PointGraph>(*currentState);
+        journal.clear();
+    }
+}
+
+void SimulatedAnnealingTSP::materialiseBest() const {
+    if(!bestPending)
+        return;
+    shared_ptr<PointGraph> state = make_shared<PointGraph>(*journalBase);
+    for(size_t i = 0; i < bestJournalLength; i++)
+        applyJournalEntry(*state, journal[i]);
+    bestState = state;
+    bestPending = false;
+}
+
+void SimulatedAnnealingTSP::restartJournal() {
+    materialiseBest();
+    journalBase = bestState;
+    journal.clear();
+}
+
+void SimulatedAnnealingTSP::dropJournal() {
+    materialiseBest();
+    journalBase = nullptr;
+    journal.clear();
+}
+
 double SimulatedAnnealingTSP::getRandomProbability() {
     return randDoubleGen.getRandomUniform();
 }
 
 void SimulatedAnnealingTSP::annealAll() {
 
+    int acceptedInWindow = 0;
     for(int i = 0; i < kStop; i++) {
-        if(i % (kStop / 10) == 0) {
+        if(parallelism != Parallelism::None && acceptanceChoice == Acceptance::Metropolis) {
+            k = i;
+            annealParallel();
+            break;
+        }
+        if(verbose && i % (kStop / 10) == 0) {
             cout << "Iteration " << i << endl;
             cout << "Temperature " << T << endl;
             cout << "Energy " << E << endl << endl;
         }
         k = i;
         iterationsSinceBest++;
-        shared_ptr<PointGraph> candidate = getNextState();
-        attemptAccepting(candidate);
+        double previousE = E;
+        makeMove();
+        if(E != previousE)
+            acceptedInWindow++;
         T = getTemperature();
 
         if(iterationsSinceBest > maxHigherEnergyIterations) {
+            restartJournal();
             currentState = make_shared<PointGraph>(*bestState);
             E = getEnergy(currentState);
             iterationsSinceBest = 0;
         }
+        if(resyncInterval > 0 && (i + 1) % resyncInterval == 0)
+            resyncEnergy();
 
         energyHistory.push_back(E);
         temperatureHistory.push_back(T);
+
+        bool rejectionFree = rejectionFreeRate > 0. && acceptanceChoice == Acceptance::Metropolis;
+        if(rejectionFree && (i + 1) % acceptanceWindow == 0) {
+            if(acceptedInWindow < rejectionFreeRate * acceptanceWindow && T > 0.) {
+                k = i + 1;
+                annealRejectionFree();
+                break;
+            }
+            acceptedInWindow = 0;
+        }
     }
+    resyncEnergy();
     T = 0.;
 
+    restartJournal();
     currentState = make_shared<PointGraph>(*bestState);
     E = getEnergy(currentState);
 
-    for(int i = 0; i < maxHillDescendingIterations; i++) {
-        shared_ptr<PointGraph> candidate = getNextState();
-        attemptAccepting(candidate);
+    if(hillDescentChoice == HillDescent::LocalSearch) {
+        localSearch = make_shared<LocalSearchTSP>(*currentState);
+        localSearch->run();
+        dropJournal();
+        currentState = make_shared<PointGraph>(localSearch->getGraph());
+        E = localSearch->getLength();
         energyHistory.push_back(E);
         temperatureHistory.push_back(T);
     }
+    else {
+        for(int i = 0; i < maxHillDescendingIterations; i++) {
+            makeMove();
+            energyHistory.push_back(E);
+            temperatureHistory.push_back(T);
+        }
+    }
+    updateBest();
+
+    if(verbose && nextStateChoice == NextState::Adaptive) {
+        cout << "---Move operators---" << endl;
+        printOperatorStats(cout);
+        cout << endl;
+    }
+}
+
+void SimulatedAnnealingTSP::annealRejectionFree() {
+    if(verbose)
+        cout << "---Rejection-free annealing from iteration " << k << "---" << endl << endl;
+
+    RejectionFreeTSP rejectionFree(*currentState, T, rejectionFreeNeighbours);
+    double weightsT = T;
+    while(k < kStop) {
+        double p = rejectionFree.getAcceptanceRate();
+        if(p <= 0.)
+            break;  // Frozen, no move would ever be accepted
+
+        // Iterations up to and including the next accepted one are geometrically distributed
+        double wait = p >= 1. ? 1. : 1. + floor(log(1. - getRandomProbability()) / log1p(-p));
+        if(wait >= (double) (kStop - k))
+            break;
+        k += (int) wait;
+        rejectionFree.applyRandomMove(getRandomProbability());
+
+        T = getTemperature();
+        if(abs(T - weightsT) > rejectionFreeTolerance * weightsT) {
+            rejectionFree.setTemperature(T);
+            weightsT = T;
+        }
+        energyHistory.push_back(rejectionFree.getLength());
+        temperatureHistory.push_back(T);
+    }
+    k = kStop;
+    T = getTemperature();
+
+    dropJournal();
+    currentState = make_shared<PointGraph>(rejectionFree.getGraph());
+    E = getEnergy(currentState);
+    if(rejectionFree.getBestLength() < bestE) {
+        bestState = make_shared<PointGraph>(rejectionFree.getBestGraph());
+        bestE = getEnergy(bestState);
+    }
     updateBest();
 }
 
+template<typename Engine>
+void SimulatedAnnealingTSP::annealEpochs(Engine& engine) {
+    int epoch = epochLength > 0 ? epochLength : max(1, (int) currentState->size());
+    while(k < kStop) {
+        int moves = min(epoch, kStop - k);
+        engine.runEpoch(T, moves, minMoveRange > 0 ? getScaledMoveRange(currentState->size()) : 0);
+        k += moves;
+        T = getTemperature();
+        energyHistory.push_back(engine.getLength());
+        temperatureHistory.push_back(T);
+    }
+    if(verbose)
+        cout << "Epochs " << engine.getEpochs() << ", accepted moves " << engine.getAcceptedMoves() << endl << endl;
+
+    dropJournal();
+    currentState = make_shared<PointGraph>(engine.getGraph());
+    E = getEnergy(currentState);
+    if(engine.getBestLength() < bestE) {
+        bestState = make_shared<PointGraph>(engine.getBestGraph());
+        bestE = getEnergy(bestState);
+    }
+    updateBest();
+}
+
+void SimulatedAnnealingTSP::annealParallel() {
+    if(verbose)
+        cout << "---" << (parallelism == Parallelism::Domains ? "Domain-decomposition" : "Speculative")
+             << " annealing on " << parallelThreads << " threads---" << endl << endl;
+
+    if(parallelism == Parallelism::Domains) {
+        DomainAnnealingTSP domains(*currentState, parallelThreads);
+        annealEpochs(domains);
+    }
+    else {
+        SpeculativeAnnealingTSP speculative(*currentState, parallelThreads);
+        annealEpochs(speculative);
+        conflictRate = speculative.getConflictRate();
+        if(verbose)
+            cout << "Conflict rate " << conflictRate << endl << endl;
+    }
+}
+
+void SimulatedAnnealingTSP::resyncEnergy() {
+    maxDrift = max(maxDrift, currentState->resyncTotalDistance(resyncThreads));
+    E = getEnergy(currentState);
+    materialiseBest();
+    maxDrift = max(maxDrift, bestState->resyncTotalDistance(resyncThreads));
+    bestE = getEnergy(bestState);
+}
+
+void SimulatedAnnealingTSP::startHillDescending() {
+    resyncEnergy();
+    T = 0.;
+    restartJournal();
+    currentState = make_shared<PointGraph>(*bestState);
+    E = getEnergy(currentState);
+    if(hillDescentChoice == HillDescent::LocalSearch) {
+        localSearch = make_shared<LocalSearchTSP>(*currentState);
+        localSearchSynced = false;
+    }
+    if(verbose) {
+        cout << "---Ending annealing---" << endl << endl;
+        cout << "---Starting hill-descending---" << endl;
+        cout << "Temperature " << T << endl;
+        cout << "Energy " << E << endl << endl;
+    }
+}
+
 bool SimulatedAnnealingTSP::makeStep() {
     if(k < kStop) {
-        if(k % (kStop / 10) == 0) {
+        if(verbose && k % (kStop / 10) == 0) {
             cout << "Iteration " << k << ": " << endl;
             cout << "Temperature " << T << endl;
             cout << "Energy " << E << endl << endl;
         }
         k++;
         iterationsSinceBest++;
-        shared_ptr<PointGraph> candidate = getNextState();
-        attemptAccepting(candidate);
+        makeMove();
         T = getTemperature();
 
         if(iterationsSinceBest > maxHigherEnergyIterations) {
+            restartJournal();
             currentState = make_shared<PointGraph>(*bestState);
             E = getEnergy(currentState);
             iterationsSinceBest = 0;
         }
+        if(resyncInterval > 0 && k % resyncInterval == 0)
+            resyncEnergy();
 
         energyHistory.push_back(E);
         temperatureHistory.push_back(T);
         return true;
     }
-    else if(k >= kStop && k < kStop + maxHillDescendingIterations) {
-        if(k == kStop) {
-            T = 0.;
-            currentState = make_shared<PointGraph>(*bestState);
-            E = getEnergy(currentState);
-            cout << "---Ending annealing---" << endl << endl;
-            cout << "---Starting hill-descending---" << endl;
-            cout << "Temperature " << T << endl;
-            cout << "Energy " << E << endl << endl;
+    else if(hillDescentChoice == HillDescent::LocalSearch) {
+        if(!localSearch)
+            startHillDescending();
+        // Every step applies one improving move, the phase ends by itself at a local optimum. Only E follows the
+        // moves, the O(n) copy of the tour into currentState and bestState is made once at the optimum.
+        if(localSearch->step()) {
+            k++;
+            E = localSearch->getLength();
+            energyHistory.push_back(E);
+            temperatureHistory.push_back(T);
+            return true;
         }
-        if(k % ((kStop + maxHillDescendingIterations) / 10) == 0) {
+        if(!localSearchSynced) {
+            dropJournal();
+            currentState = make_shared<PointGraph>(localSearch->getGraph());
+            E = localSearch->getLength();
+            updateBest();
+            localSearchSynced = true;
+        }
+    }
+    else if(k >= kStop && k < kStop + maxHillDescendingIterations) {
+        if(k == kStop)
+            startHillDescending();
+        if(verbose && k % ((kStop + maxHillDescendingIterations) / 10) == 0) {
             cout << "Iteration " << k << ": " << endl;
             cout << "Temperature " << T << endl;
             cout << "Energy " << E << endl << endl;
         }
         k++;
-        shared_ptr<PointGraph> candidate = getNextState();
-        attemptAccepting(candidate);
+        makeMove();
         energyHistory.push_back(E);
         temperatureHistory.push_back(T);
         updateBest();
         return true;
     }
 
-    cout << "---Ending hill-descending---" << endl;
-    cout << "Temperature " << T << endl;
-    cout << "Energy " << E << endl << endl;
+    if(verbose) {
+        cout << "---Ending hill-descending---" << endl;
+        cout << "Temperature " << T << endl;
+        cout << "Energy " << E << endl << endl;
+    }
 
     return false;
 }
 
+vector<OperatorStats> SimulatedAnnealingTSP::getOperatorStats() const {
+    vector<OperatorStats> totals(SimulatedAnnealingTSP::operatorsNumber, OperatorStats{0, 0, 0., 0, 0.});
+    for(size_t i = 0; i < operatorStats.size(); i++) {
+        OperatorStats& total = totals[i % SimulatedAnnealingTSP::operatorsNumber];
+        total.proposals += operatorStats[i].proposals;
+        total.accepted += operatorStats[i].accepted;
+        total.improvement += operatorStats[i].improvement;
+        total.timed += operatorStats[i].timed;
+        total.seconds += operatorStats[i].seconds;
+    }
+    return totals;
+}
+
+void SimulatedAnnealingTSP::printOperatorStats(ostream& out) const {
+    const char* names[] = {"Swap", "TwoOpt", "OrOpt", "SegmentInsertion"};
+    vector<OperatorStats> totals = getOperatorStats();
+    for(int o = 0; o < SimulatedAnnealingTSP::operatorsNumber; o++) {
+        const OperatorStats& stats = totals[o];
+        out << names[o] << ": " << stats.proposals << " moves, "
+            << (stats.proposals == 0 ? 0. : 100. * (double) stats.accepted / (double) stats.proposals)
+            << "% accepted, improvement " << stats.improvement << ", " << stats.getNsPerMove() << " ns/move, "
+            << 1000. * stats.getRate() << " improvement/us" << endl;
+    }
+}
+
+void SimulatedAnnealingTSP::swapHistory(vector<double>& energies, vector<double>& temperatures) {
+    swap(energyHistory, energies);
+    swap(temperatureHistory, temperatures);
+    energyHistory.assign(1, E);
+    temperatureHistory.assign(1, T);
+}
+
 const vector<double> &SimulatedAnnealingTSP::getEnergyHistory() const {
     return energyHistory;
 }
@@ -343,6 +1285,7 @@ double SimulatedAnnealingTSP::getBestE() const {
 }
 
 const shared_ptr<PointGraph> &SimulatedAnnealingTSP::getBestState() const {
+    materialiseBest();
     return bestState;
 }
 
@@ -18,6 +18,14 @@
 #include <random>
 #include <chrono>
 #include <ctime>
+#include <algorithm>
+#include <thread>
+#include <cstdint>
+#include <mutex>
+#include <tuple>
+#include <variant>
+
+#include "tour.h"
 
 
 
@@ -25,6 +33,28 @@ using namespace std;
 
 
 
+// Neumaier (improved Kahan) summation, keeps the rounding error of long sequences of deltas bounded
+class CompensatedSum {
+private:
+    double sum;
+    double compensation;  // Low-order bits lost by sum
+
+public:
+    explicit CompensatedSum(double value=0.): sum{value}, compensation{0.} {}
+
+    void add(double value) {
+        double t = sum + value;
+        if(abs(sum) >= abs(value))
+            compensation += (sum - t) + value;
+        else
+            compensation += (value - t) + sum;
+        sum = t;
+    }
+
+    [[nodiscard]] double value() const { return sum + compensation; }
+};
+
+
 class RandomDoubleGenerator {
 private:
     mt19937 gen;
@@ -34,6 +64,8 @@ private:
 public:
     RandomDoubleGenerator(double from, double to, double mean, double sd);
 
+    RandomDoubleGenerator(double from, double to, double mean, double sd, mt19937::result_type seed);
+
     double getRandomUniform();
 
     double getRandomNormal();
@@ -47,10 +79,19 @@ private:
 public:
     RandomIntGenerator(int from, int to);
 
+    RandomIntGenerator(int from, int to, mt19937::result_type seed);
+
     int getRandomUniform();
+
+    int getRandomUniform(int from, int to);
 };
 
 
+// Rounded is the EUC_2D metric of TSPLIB: every edge is the nearest integer to its Euclidean length,
+// so tour lengths and move deltas are exact and agree with published optimal tour lengths.
+enum class DistanceMetric { Euclidean, Rounded };
+
+
 class Point {
 private:
     double x;
@@ -69,43 +110,254 @@ public:
 
     [[nodiscard]] double getDistanceTo(const Point& other) const;
 
+    [[nodiscard]] int32_t getRoundedDistanceTo(const Point& other) const {
+        return (int32_t) (getDistanceTo(other) + 0.5);
+    }
+
+    [[nodiscard]] double getDistanceTo(const Point& other, DistanceMetric metric) const {
+        return metric == DistanceMetric::Rounded ? (double) getRoundedDistanceTo(other) : getDistanceTo(other);
+    }
+
     static double getDistanceBetween(const Point& pA, const Point& pB);\
 
     [[nodiscard]] string toString() const { return '(' + to_string(x) + ", "  + to_string(y) + ')'; }
 };
 
 
+// Single keeps a float copy of the coordinates, recentred on the bounding box centre, and computes
+// edge lengths in float. Half the size of the double coordinates and accurate to about 1e-7 of the
+// instance extent; energies are still accumulated in double. The copy is made by the instance when the
+// first Single graph over it is created, so instances of Double graphs hold only the double coordinates.
+enum class Precision { Double, Single };
+
+
+// City coordinates used by the Single precision kernels
+struct CompactPoint {
+    float x;
+    float y;
+};
+
+
+class NeighbourLists;
+
+
+// Read-only city data shared by every tour over the same cities, e.g. the states of all annealing replicas,
+// which then own only their tour permutations. Cities are numbered along a Hilbert curve (see hilbert.h),
+// so cities close in the plane are close in memory.
+class Instance {
+private:
+    vector<Point> cities;  // Cities in Hilbert curve order
+    mutable vector<CompactPoint> compactCities;  // Copy of cities recentred on the bounding box centre, in float
+    mutable once_flag compactCitiesBuilt;  // compactCities is only built for graphs of Precision::Single
+    vector<int> inputNumbers;  // City number of every input point, i.e. the input order as a tour
+    double edgeLength;  // Expected edge length of an optimal tour through n uniform cities of the bounding box
+    mutable mutex neighboursMutex;  // Guards neighbourLists, which replicas may request concurrently
+    mutable vector<tuple<int, DistanceMetric, shared_ptr<const NeighbourLists>>> neighbourLists;  // Built so far
+
+public:
+    explicit Instance(const vector<Point>& points);
+
+    [[nodiscard]] size_t size() const { return cities.size(); }
+
+    [[nodiscard]] const Point& getCity(int city) const { return cities[city]; }
+
+    [[nodiscard]] const vector<Point>& getCities() const { return cities; }
+
+    // Builds compactCities on the first call, which must precede getCompactCity()
+    void prepareCompactCities() const;
+
+    [[nodiscard]] const CompactPoint& getCompactCity(int city) const { return compactCities[city]; }
+
+    [[nodiscard]] const vector<int>& getInputNumbers() const { return inputNumbers; }
+
+    // 0.7124 * sqrt(area / n), 1 for degenerate instances
+    [[nodiscard]] double getEdgeLength() const { return edgeLength; }
+
+    // Lists of the neighboursNumber nearest cities, built on the first request and shared afterwards
+    [[nodiscard]] shared_ptr<const NeighbourLists> getNeighbourLists(int neighboursNumber, DistanceMetric metric) const;
+};
+
+
+// Relocation of the segment [first, last] between positions after and after + 1.
+// The change of total distance is computed from the six affected edges.
+struct SegmentMove {
+    size_t first;  // Position of the first city of the segment
+    size_t last;  // Position of the last city of the segment (first <= last)
+    size_t after;  // Position of the city the segment is inserted after (outside [first - 1, last])
+    bool reversed;  // Whether the segment is inserted in reverse order
+    double delta;  // Change of total distance
+};
+
+
+// Exchange of the cities at positions idxA and idxB
+struct SwapMove {
+    size_t idxA;
+    size_t idxB;
+    double delta;  // Change of total distance
+};
+
+
+// Reversal of the length positions starting at first (cyclically), i.e. a 2-opt move
+struct TwoOptMove {
+    size_t first;
+    size_t length;  // 2 <= length <= size - 2
+    double delta;  // Change of total distance
+};
+
+
 class PointGraph {
 private:
-    vector<Point> points;
+    constexpr static int maxWindowDraws = 16;  // Draws of a segment start in the window before using the whole tour
+
+    shared_ptr<const Instance> instance;  // Cities, shared by all copies of the graph
+    vector<int> order;  // City at every tour position
     size_t _size;
     RandomIntGenerator randIndexGen;
+    TourRepresentation representation;  // Tour representation used by the flip-based optimisers
+    DistanceMetric metric;  // Length of a single edge
+    Precision precision;  // Precision of the edge lengths computed by the moves
+    CompensatedSum totalDistance;  // Cached tour length, kept up to date by the deltas of the moves
+    long long roundedTotalDistance;  // Cached tour length used instead of totalDistance by the Rounded metric
+    bool totalDistanceValid;  // Whether totalDistance has to be recomputed
+    size_t moveRange;  // Largest tour-position offset between the endpoints of a random move, 0 for no limit
+    size_t windowStart;  // First endpoints of random moves are drawn from the windowLength positions
+    size_t windowLength;  // starting at windowStart (cyclically), or from the whole tour when 0
+
+    // Length of the edge between positions idxA and idxB
+    [[nodiscard]] double distance(size_t idxA, size_t idxB) const {
+        if(precision == Precision::Single) {
+            const CompactPoint& a = instance->getCompactCity(order[idxA]);
+            const CompactPoint& b = instance->getCompactCity(order[idxB]);
+            float dx = a.x - b.x;
+            float dy = a.y - b.y;
+            float d = sqrt(dx * dx + dy * dy);
+            return metric == DistanceMetric::Rounded ? (double) (int32_t) (d + 0.5f) : (double) d;
+        }
+        return instance->getCity(order[idxA]).getDistanceTo(instance->getCity(order[idxB]), metric);
+    }
+
+    // Replaces the cities by a new instance, in input order
+    void setCities(const vector<Point>& points);
+
+    void swapPositions(size_t idxA, size_t idxB) { swap(order[idxA], order[idxB]); }
+
+    // Length of the path between positions from - 1 and to - 1 (edges leaving from - 1 .. to - 2)
+    [[nodiscard]] double getPathLength(size_t from, size_t to) const;
+
+    [[nodiscard]] double getEdgesLength(size_t idxA, size_t idxB) const;
+
+    void addToTotalDistance(double delta) {
+        if(metric == DistanceMetric::Rounded)
+            roundedTotalDistance += (long long) delta;  // Sums of rounded edges are exact integers
+        else
+            totalDistance.add(delta);
+    }
+
+    void verifyTotalDistance() const;
+
+    // First endpoint of a random move
+    size_t randomPosition();
+
+    // First position of a random segment of length cities not wrapping around the tour end, uniform in
+    // [0, _size - length] and, with a window, redrawn until it falls in that range
+    size_t randomSegmentStart(size_t length);
+
+    // Offset in [0, count - 1] of the second endpoint, where both ends of the interval are the offsets
+    // closest to the first endpoint. Limited to the moveRange offsets at either end, so endpoints are at most
+    // moveRange positions beyond the nearest valid one.
+    size_t randomOffset(size_t count);
 public:
     PointGraph():
 
-            points{vector<Point>()},
+            instance{make_shared<const Instance>(vector<Point>())},
+            order{vector<int>()},
             _size{0},
-            randIndexGen{RandomIntGenerator(0, 0)}
+            randIndexGen{RandomIntGenerator(0, 0)},
+            representation{TourRepresentation::Array},
+            metric{DistanceMetric::Euclidean},
+            precision{Precision::Double},
+            totalDistance{CompensatedSum()},
+            roundedTotalDistance{0},
+            totalDistanceValid{false},
+            moveRange{0},
+            windowStart{0},
+            windowLength{0}
     {}
 
-    explicit PointGraph(const vector<Point>& vec):
+    explicit PointGraph(const vector<Point>& vec, TourRepresentation representation=TourRepresentation::Array,
+                        DistanceMetric metric=DistanceMetric::Euclidean, Precision precision=Precision::Double):
 
-            points{vec},
+            instance{make_shared<const Instance>(vec)},
+            order{instance->getInputNumbers()},
             _size{vec.size()},
-            randIndexGen{RandomIntGenerator(0, (int) vec.size() - 1)}
-    {}
+            randIndexGen{RandomIntGenerator(0, (int) vec.size() - 1)},
+            representation{representation},
+            metric{metric},
+            precision{precision},
+            totalDistance{CompensatedSum()},
+            roundedTotalDistance{0},
+            totalDistanceValid{false},
+            moveRange{0},
+            windowStart{0},
+            windowLength{0}
+    {
+        if(precision == Precision::Single)
+            instance->prepareCompactCities();
+    }
+
+    // Tour visiting the cities of instance in the given order
+    PointGraph(shared_ptr<const Instance> instance, vector<int> order, TourRepresentation representation,
+               DistanceMetric metric, Precision precision):
+
+            instance{move(instance)},
+            order{move(order)},
+            _size{this->order.size()},
+            randIndexGen{RandomIntGenerator(0, (int) this->order.size() - 1)},
+            representation{representation},
+            metric{metric},
+            precision{precision},
+            totalDistance{CompensatedSum()},
+            roundedTotalDistance{0},
+            totalDistanceValid{false},
+            moveRange{0},
+            windowStart{0},
+            windowLength{0}
+    {
+        if(precision == Precision::Single)
+            this->instance->prepareCompactCities();
+    }
 
     PointGraph(const PointGraph& other):
 
+            instance{other.instance},  // Copies share the cities and own only the tour
+            order{other.order},
             _size{other._size},
             randIndexGen{RandomIntGenerator(0, (int) other.size() - 1)},
-            points{other.points}  // Deep copy as points vector consists of Point objects, not Point* pointers.
+            representation{other.representation},
+            metric{other.metric},
+            precision{other.precision},
+            totalDistance{other.totalDistance},
+            roundedTotalDistance{other.roundedTotalDistance},
+            totalDistanceValid{other.totalDistanceValid},
+            moveRange{other.moveRange},
+            windowStart{other.windowStart},
+            windowLength{other.windowLength}
     {}
 
     PointGraph(PointGraph&& other) noexcept:
+            instance{other.instance},
+            order{move(other.order)},
             _size{other._size},
             randIndexGen{RandomIntGenerator(0, (int) other.size() - 1)},
-            points{move(other.points)} { other._size = 0; }
+            representation{other.representation},
+            metric{other.metric},
+            precision{other.precision},
+            totalDistance{other.totalDistance},
+            roundedTotalDistance{other.roundedTotalDistance},
+            totalDistanceValid{other.totalDistanceValid},
+            moveRange{other.moveRange},
+            windowStart{other.windowStart},
+            windowLength{other.windowLength} { other._size = 0; other.totalDistanceValid = false; }
 
     ~PointGraph() = default;
 
@@ -117,31 +369,159 @@ public:
 
     void initGraphNormal(RandomDoubleGenerator& randGenX, RandomDoubleGenerator& randGenY, size_t size);
 
+    // Cluster centres are drawn uniformly, cities are normally distributed around them
+    // (the normal distributions of the generators are used as offsets, so their mean should be 0).
+    void initGraphClustered(RandomDoubleGenerator& randGenX, RandomDoubleGenerator& randGenY, size_t size,
+                            size_t clustersNumber);
+
+    // Reorders the cities along a Hilbert curve, which makes cities close in the plane close in memory and
+    // gives a starting tour some 25-40% above optimal. Points keep their labels.
+    void sortAlongHilbertCurve();
+
     [[nodiscard]] size_t size() const {return _size; }
 
+    [[nodiscard]] TourRepresentation getTourRepresentation() const { return representation; }
+
+    void setTourRepresentation(TourRepresentation newRepresentation) { representation = newRepresentation; }
+
+    [[nodiscard]] DistanceMetric getDistanceMetric() const { return metric; }
+
+    void setDistanceMetric(DistanceMetric newMetric) { metric = newMetric; totalDistanceValid = false; }
+
+    [[nodiscard]] Precision getPrecision() const { return precision; }
+
+    void setPrecision(Precision newPrecision) {
+        precision = newPrecision;
+        totalDistanceValid = false;
+        if(precision == Precision::Single)
+            instance->prepareCompactCities();
+    }
+
+    [[nodiscard]] size_t getMoveRange() const { return moveRange; }
+
+    // Limits the random moves to endpoints at most about range tour positions apart (0 for no limit), and
+    // their first endpoints to the windowLength positions from windowStart (0 for the whole tour)
+    void setMoveRange(size_t range, size_t newWindowStart=0, size_t newWindowLength=0) {
+        moveRange = range;
+        windowStart = _size == 0 ? 0 : newWindowStart % _size;
+        windowLength = min(newWindowLength, _size);
+    }
+
+    // O(1) unless the graph was re-initialised since the last call
     double getTotalDistance();
 
+    // Exact tour length of the Rounded metric
+    long long getRoundedTotalDistance() { return llround(getTotalDistance()); }
+
+    // Full O(n) walk over the tour, ignoring the cached value, optionally split between threads
+    [[nodiscard]] double computeTotalDistance(int threads=1) const;
+
+    // Replaces the cached tour length by a full recompute, returns the drift of the cached value
+    double resyncTotalDistance(int threads=1);
+
     void consecutiveSwap();
 
     void arbitrarySwap();
 
+    // Or-opt: segment of 1 to 3 cities relocated in the better of its two orientations
+    SegmentMove randomOrOpt();
+
+    // Or-3opt: segment of any length relocated without reversal
+    SegmentMove randomSegmentInsertion();
+
+    [[nodiscard]] double getSegmentMoveDelta(size_t first, size_t last, size_t after, bool reversed) const;
+
+    constexpr static int maxBatchSize = 64;  // Largest number of swaps evaluated by one randomSwapBatch call
+
+    // Draws count arbitrary swaps of non-adjacent positions and evaluates all deltas in one pass over
+    // coordinates gathered into contiguous arrays. Needs at least 5 cities, returns false otherwise.
+    bool randomSwapBatch(SwapMove* moves, int count);
+
+    // The move must have been drawn on the current state, its delta updates the cached tour length
+    void applySwap(const SwapMove& move);
+
+    // Needs at least 5 cities, returns an empty reversal otherwise
+    TwoOptMove randomTwoOpt();
+
+    [[nodiscard]] double getTwoOptDelta(size_t first, size_t length) const;
+
+    // Reverses the shorter of the two paths, which gives the same cyclic tour.
+    // The move must have been drawn on the current state, its delta updates the cached tour length
+    void reverseSegment(const TwoOptMove& move);
+
+    // The move must have been drawn on the current state, its delta updates the cached tour length
+    void moveSegment(const SegmentMove& move);
+
     friend ostream& operator<<(ostream& out, const PointGraph& graph) {
         string pointStr{};
-        for(auto p: graph.points) {
-            pointStr += p.toString();
+        for(int city: graph.order) {
+            pointStr += graph.instance->getCity(city).toString();
             pointStr += '\n';
         }
         return out << "---PointGraph---\nsize: " << graph._size << "\npoints:\n" << pointStr;
     }
 
-    const vector<Point> &getPoints() const { return points; }
+    // Copy of the cities in tour order
+    [[nodiscard]] vector<Point> getPoints() const;
+
+    [[nodiscard]] const shared_ptr<const Instance>& getInstance() const { return instance; }
+
+    [[nodiscard]] const vector<int>& getOrder() const { return order; }
 };
 
 
 
 enum class Temperature { Linear, PowerSlow, PowerFast };
 
-enum class NextState { Consecutive, Arbitrary, Mixed };
+// MixedBatch evaluates the arbitrary swaps of Mixed all at once and applies one of them in place.
+// Adaptive draws every move from one of the operators below, favouring those with the largest
+// improvement per nanosecond at the current temperature.
+enum class NextState { Consecutive, Arbitrary, Mixed, OrOpt, SegmentInsertion, MixedBatch, TwoOpt, Adaptive };
+
+// Move operators of NextState::Adaptive
+enum class MoveOperator { Swap, TwoOpt, OrOpt, SegmentInsertion };
+
+
+// Counters of one move operator
+struct OperatorStats {
+    long long proposals;  // Number of drawn moves
+    long long accepted;  // Number of applied moves
+    double improvement;  // Sum of the energy decreases of improving moves
+    long long timed;  // Number of proposals whose wall time was measured
+    double seconds;  // Wall time of the timed proposals (drawing, evaluating and applying)
+
+    [[nodiscard]] double getNsPerMove() const { return timed == 0 ? 0. : seconds * 1e9 / (double) timed; }
+
+    // Improvement per nanosecond spent in the operator
+    [[nodiscard]] double getRate() const {
+        double ns = getNsPerMove() * (double) proposals;
+        return ns == 0. ? 0. : improvement / ns;
+    }
+};
+
+enum class HillDescent { RandomCandidates, LocalSearch };
+
+// Rule deciding whether a candidate of higher energy is accepted (improvements always are):
+// Metropolis - with probability exp(-delta / T),
+// ThresholdAccepting - if delta < T,
+// GreatDeluge - if below a water level lowered from the initial energy to the best one as T falls,
+// RecordToRecord - if less than T above the best energy,
+// LateAcceptance - if below the energy of lateAcceptanceLength iterations ago (T only ends the phase).
+// Only Metropolis needs a random draw and exp, at T = 0 every rule accepts improvements only.
+enum class Acceptance { Metropolis, ThresholdAccepting, GreatDeluge, RecordToRecord, LateAcceptance };
+
+// Parallel annealing of a single tour by annealAll():
+// None - one chain on one thread,
+// Domains - every thread anneals its own region of the tour, see domain_decomposition.h,
+// Speculative - threads move anywhere on the shared tour, claiming the positions they touch, see speculative.h.
+enum class Parallelism { None, Domains, Speculative };
+
+
+class LocalSearchTSP;
+
+
+// Move applied in place to the current state of the annealing, replayed to rebuild its best state
+using JournalEntry = variant<SegmentMove, SwapMove, TwoOptMove>;
 
 
 
@@ -149,14 +529,27 @@ class SimulatedAnnealingTSP {
 private:
 
     // Constants / initial parameters
-    constexpr static double initialT = 1000.;  // Initial temperature
     constexpr static int mixedAttemptsNumber = 10;  // Number of attempts to arbitrarily find next state in mixed choice
+    constexpr static int defaultResyncInterval = 1000000;  // Default number of iterations between energy resyncs
+    constexpr static int acceptanceWindow = 10000;  // Number of iterations the acceptance rate is measured over
+    constexpr static double rejectionFreeTolerance = 0.05;  // Relative change of T which rebuilds rejection-free weights
+    constexpr static int lateAcceptanceLength = 5000;  // Number of past energies kept by LateAcceptance
+    constexpr static int operatorsNumber = 4;  // Number of MoveOperator values
+    constexpr static int temperatureBands = 16;  // Adaptive statistics are kept for T in [T0 / 2^(b + 1), T0 / 2^b)
+    constexpr static double minOperatorProbability = 0.05;  // Share of moves every operator keeps for exploration
+    constexpr static int operatorUpdateInterval = 1000;  // Number of adaptive moves between probability updates
+    constexpr static int operatorTimingInterval = 16;  // Every that many moves of an operator is timed
+    constexpr static double moveRangeScale = 256.;  // Move range at T equal to the optimal edge length
+    constexpr static size_t journalFraction = 4;  // The journal is rebased once it holds n / journalFraction moves
+    constexpr static size_t minJournalLength = 64;  // Journal length never causing a rebase
     const int kStop;  // Desired number of iterations
     const shared_ptr<PointGraph> initialState;  // Initial state (input graph)
     const Temperature temperatureChoice;  // Defines which method to use when calculating temperature
     const NextState nextStateChoice;  // Defines which method to use when finding next state
     const int maxHigherEnergyIterations;  // Defines the number of higher energy iterations to reset to best state
     const int maxHillDescendingIterations;  // Defines the number of iterations to be made after reaching T = 0
+    const HillDescent hillDescentChoice;  // Defines which method to use after reaching T = 0
+    const Acceptance acceptanceChoice;  // Defines which rule accepts candidates of higher energy
     RandomDoubleGenerator randDoubleGen;  // Used to get random double from 0. to 1.
 
     // Variables describing current situation
@@ -164,13 +557,53 @@ private:
     double T;  // Current temperature
     double E;  // Current energy
     shared_ptr<PointGraph> currentState;  // Current state (graph)
+    vector<double> lateEnergies;  // Circular history of energies used by LateAcceptance
+    int lateIndex;  // Entry of lateEnergies compared and replaced in the current iteration
 
     // History variables
     vector<double> energyHistory;  // Vector containing history of energy change
     vector<double> temperatureHistory;  // Vector containing history of temperature change
     double bestE;  // Lowest energy so far
-    shared_ptr<PointGraph> bestState;  // State which had lowest energy so far
+    mutable shared_ptr<PointGraph> bestState;  // State which had lowest energy so far (stale while bestPending)
     int iterationsSinceBest;  // Number of iterations since being in best state
+    shared_ptr<LocalSearchTSP> localSearch;  // 2-opt / Or-opt optimiser of the hill-descending phase
+    bool localSearchSynced;  // Whether currentState and bestState hold the local optimum of localSearch
+    bool verbose;  // Whether progress is printed to cout
+
+    // Best state journal. In-place moves are logged instead of copying the tour on every new best, the best
+    // state is journalBase with the first bestJournalLength moves and is only built when needed.
+    shared_ptr<PointGraph> journalBase;  // State the journal starts from, null if the current state is not its result
+    vector<JournalEntry> journal;  // Moves applied to the current state since journalBase
+    size_t bestJournalLength;  // Number of journal moves leading to the best state
+    mutable bool bestPending;  // Whether bestState still has to be built from the journal
+
+    // Drift control of the incrementally tracked energies
+    int resyncInterval;  // Number of iterations between full recomputes of E and bestE (0 disables them)
+    int resyncThreads;  // Number of threads used by a full recompute
+    double maxDrift;  // Largest difference between a tracked energy and its recompute so far
+
+    // Adaptive operator selection
+    vector<OperatorStats> operatorStats;  // Stats of operator o in band b at [b * operatorsNumber + o]
+    double operatorProbabilities[operatorsNumber];  // Sampling probabilities in the current band
+    int operatorBand;  // Band the probabilities were computed for
+    long long adaptiveMoves;  // Number of moves drawn by the adaptive scheduler
+
+    // Temperature-scaled move range
+    size_t minMoveRange;  // Lower bound of the move range, 0 leaves the moves unlimited
+    size_t moveWindow;  // Length of the sliding window of first endpoints, 0 for the whole tour
+    size_t moveWindowStart;  // Current position of the window
+    size_t moveWindowMoves;  // Number of moves made since the window last advanced
+    double moveRangeEdge;  // Expected edge length of an optimal tour, the unit of the move range
+
+    // Rejection-free low temperature phase
+    double rejectionFreeRate;  // Acceptance rate below which annealAll() switches to it (0 disables it)
+    int rejectionFreeNeighbours;  // Neighbours per city defining its moves
+
+    // Parallel annealing of the tour
+    Parallelism parallelism;  // How annealAll() splits the iterations between threads
+    int parallelThreads;  // Number of threads
+    int epochLength;  // Number of iterations between synchronisations of the threads, 0 for one per city
+    double conflictRate;  // Share of conflicting claims of the Speculative run
 
     double getTemperature();
 
@@ -184,55 +617,192 @@ private:
 
     void attemptAccepting(shared_ptr<PointGraph>& candidate);
 
-    [[nodiscard]] double acceptanceProbability(double candidateE) const;
+    void attemptAccepting(const SegmentMove& move);
+
+    void attemptAccepting(const SwapMove& move);
+
+    void attemptAccepting(const TwoOptMove& move);
+
+    // Applies the best improving swap of a batch, otherwise the first one passing a shared Metropolis test
+    void attemptAcceptingBatch();
+
+    [[nodiscard]] int getTemperatureBand() const;
+
+    // Probability matching over the improvement rates of the operators in the current band
+    void updateOperatorProbabilities();
+
+    void makeAdaptiveMove();
+
+    // Move range for temperature T on a tour of n positions, see setMoveRange()
+    [[nodiscard]] size_t getScaledMoveRange(size_t n) const;
+
+    // Sets the move range of the current state for temperature T and advances the window
+    void applyMoveRange();
+
+    // Candidates of higher energy are accepted if their energy is below the limit (T > 0 only)
+    double acceptanceLimit();
 
     void updateBest();
 
+    // Logs a move just applied to the current state, rebasing the journal once it grows too long
+    void journalMove(const JournalEntry& entry);
+
+    // Builds bestState from the journal if it is pending
+    void materialiseBest() const;
+
+    // Restarts the journal from the best state, which the current state is about to be set to
+    void restartJournal();
+
+    // Stops the journal, the current state is about to be replaced by an unrelated one
+    void dropJournal();
+
+    void startHillDescending();
+
+    // Anneals from the current k to kStop with RejectionFreeTSP, see rejection_free.h
+    void annealRejectionFree();
+
+    // Anneals from the current k to kStop in epochs of the parallel engine (DomainAnnealingTSP
+    // or SpeculativeAnnealingTSP), one energy history entry each
+    template<typename Engine>
+    void annealEpochs(Engine& engine);
+
+    void annealParallel();
+
+    void resyncEnergy();
+
     double getRandomProbability();
 
     static double getEnergy(const shared_ptr<PointGraph>& state) { return state->getTotalDistance(); }
 
-    void annealAll();
-
 public:
+    constexpr static double initialT = 1000.;  // Initial temperature
+
     SimulatedAnnealingTSP(const shared_ptr<PointGraph>& pointGraph,
                           int numberOfIterations,
                           int maxHigherEnergyIterations,
                           int maxHillDescendingIterations,
                           Temperature temperatureChoice=Temperature::Linear,
-                          NextState nextStateChoice=NextState::Consecutive
+                          NextState nextStateChoice=NextState::Consecutive,
+                          HillDescent hillDescentChoice=HillDescent::LocalSearch,
+                          Acceptance acceptanceChoice=Acceptance::Metropolis
     ):
 
-            initialState{make_shared<PointGraph>(*pointGraph)},
             kStop{numberOfIterations},
-            maxHigherEnergyIterations{maxHigherEnergyIterations},
-            maxHillDescendingIterations{maxHillDescendingIterations},
+            initialState{make_shared<PointGraph>(*pointGraph)},
             temperatureChoice{temperatureChoice},
             nextStateChoice{nextStateChoice},
+            maxHigherEnergyIterations{maxHigherEnergyIterations},
+            maxHillDescendingIterations{maxHillDescendingIterations},
+            hillDescentChoice{hillDescentChoice},
+            acceptanceChoice{acceptanceChoice},
             randDoubleGen{RandomDoubleGenerator(0., 1., 0.5, 0.)},
 
             k{0},
             T{SimulatedAnnealingTSP::initialT},
             E{getEnergy(pointGraph)},
             currentState{make_shared<PointGraph>(*pointGraph)},
+            lateEnergies{vector<double>(acceptanceChoice == Acceptance::LateAcceptance ? lateAcceptanceLength : 0,
+                                        getEnergy(pointGraph))},
+            lateIndex{0},
 
             energyHistory{vector<double>(1, getEnergy(pointGraph))},
             temperatureHistory{vector<double>(1, SimulatedAnnealingTSP::initialT)},
             bestE{getEnergy(pointGraph)},
             bestState{make_shared<PointGraph>(*pointGraph)},
-            iterationsSinceBest{0}
+            iterationsSinceBest{0},
+            localSearch{nullptr},
+            localSearchSynced{false},
+            verbose{true},
+            journalBase{bestState},
+            journal{vector<JournalEntry>()},
+            bestJournalLength{0},
+            bestPending{false},
+            resyncInterval{SimulatedAnnealingTSP::defaultResyncInterval},
+            resyncThreads{1},
+            maxDrift{0.},
+            operatorStats{vector<OperatorStats>(temperatureBands * operatorsNumber, OperatorStats{0, 0, 0., 0, 0.})},
+            operatorProbabilities{0.25, 0.25, 0.25, 0.25},
+            operatorBand{0},
+            adaptiveMoves{0},
+            minMoveRange{0},
+            moveWindow{0},
+            moveWindowStart{0},
+            moveWindowMoves{0},
+            moveRangeEdge{1.},
+            rejectionFreeRate{0.},
+            rejectionFreeNeighbours{8},
+            parallelism{Parallelism::None},
+            parallelThreads{1},
+            epochLength{0},
+            conflictRate{0.}
     {
         // annealAll();
     }
 
+    void annealAll();
+
     bool makeStep();
 
+    // Proposes a single move of the nextStateChoice operator at the current temperature and accepts or rejects it,
+    // without cooling or recording the histories
+    void makeMove();
+
+    void setTemperature(double newT) { T = newT; }
+
+    // Acceptance test of a candidate of the given energy against the current state, drawing a random number
+    // for the randomised acceptance rules
+    [[nodiscard]] bool accepts(double candidateE) {
+        return candidateE < E || (T > 0. && candidateE < acceptanceLimit());
+    }
+
+    void setVerbose(bool newVerbose) { verbose = newVerbose; }
+
+    void setResync(int interval, int threads=1) { resyncInterval = interval; resyncThreads = threads; }
+
+    [[nodiscard]] double getMaxDrift() const { return maxDrift; }
+
+    // Once fewer than acceptanceRate of the moves in an acceptance window are accepted, annealAll() finishes
+    // the schedule rejection-free (Metropolis acceptance only). Energy history then gets one entry per accepted move.
+    void setRejectionFree(double acceptanceRate, int neighboursNumber=8) {
+        rejectionFreeRate = acceptanceRate;
+        rejectionFreeNeighbours = neighboursNumber;
+    }
+
+    // annealAll() runs the whole schedule on threads in parallel, synchronising them every epochLength
+    // iterations (Metropolis acceptance only). Energy history then gets one entry per epoch.
+    void setParallelism(Parallelism mode, int threads, int newEpochLength=0) {
+        parallelism = mode;
+        parallelThreads = threads;
+        epochLength = newEpochLength;
+    }
+
+    // Share of the claims of the last Speculative run that conflicted with another thread
+    [[nodiscard]] double getConflictRate() const { return conflictRate; }
+
+    constexpr static size_t defaultMinMoveRange = 32;  // Move range of the coldest part of the run
+
+    // Random moves reach at most max(minRange, moveRangeScale * (T / l)^2) tour positions from their first
+    // endpoint, l being the expected edge length of an optimal tour, so cold moves stay local. With window > 0
+    // first endpoints come from window consecutive positions, advanced by half the window every window moves,
+    // keeping the working set small enough for the cache.
+    void setMoveRange(size_t minRange=defaultMinMoveRange, size_t window=0);
+
+    // Totals of every operator over all temperature bands (NextState::Adaptive)
+    [[nodiscard]] vector<OperatorStats> getOperatorStats() const;
+
+    void printOperatorStats(ostream& out) const;
+
+    // Exchanges the energy and temperature histories with the given vectors and restarts them from the current
+    // state in the received ones, so a caller running many annealings can pass the buffers on and keep their capacity
+    void swapHistory(vector<double>& energies, vector<double>& temperatures);
+
     [[nodiscard]] const vector<double> &getEnergyHistory() const;
 
     [[nodiscard]] const vector<double> &getTemperatureHistory() const;
 
     [[nodiscard]] double getE() const;
 
+    // While makeStep() runs the local search of HillDescent::LocalSearch, the tour from before the descent
     [[nodiscard]] const shared_ptr<PointGraph> &getCurrentState() const;
 
     [[nodiscard]] double getBestE() const;
@@ -0,0 +1,205 @@
+/**
+ * @file batch.cpp
+ */
+
+#include "batch.h"
+
+#include <thread>
+
+
+// BatchRunner
+
+BatchRunner::BatchRunner(int threads, int iterationsPerCity, DistanceMetric metric, bool lockstep, size_t exactCities):
+
+        iterationsPerCity{max(1, iterationsPerCity)},
+        threadsNumber{max(1, threads)},
+        metric{metric},
+        lockstep{lockstep},
+        exactCities{min(exactCities, HeldKarpTSP::maxCities)},
+        queues{vector<deque<Job>>(threadsNumber)},
+        queueMutexes{vector<mutex>(threadsNumber)},
+        queued{0},
+        inputDone{false},
+        results{deque<Result>()},
+        nextResult{0}
+{}
+
+bool BatchRunner::readJob(istream& in, Job& job) {
+    size_t n;
+    if(!(in >> job.name >> n))
+        return false;
+    job.cities.clear();
+    job.cities.reserve(n);
+    for(size_t i = 0; i < n; i++) {
+        double x, y;
+        if(!(in >> x >> y)) {
+            cerr << "Instance " << job.name << " has fewer than " << n << " cities" << endl;
+            return false;
+        }
+        job.cities.emplace_back(x, y);
+    }
+    return true;
+}
+
+void BatchRunner::solve(Job& job, Scratch& scratch, Result& result) const {
+    size_t n = job.cities.size();
+    auto graph = make_shared<PointGraph>(job.cities, TourRepresentation::Array, metric);
+    if(isExact(job)) {
+        HeldKarpTSP exact(graph);
+        exact.setVerbose(false);
+        exact.annealAll();
+        setResult(exact.getBestState(), exact.getBestE(), result);
+        return;
+    }
+    if(n < BatchRunner::minAnnealedSize) {
+        result.length = graph->getTotalDistance();
+        result.tour = identityOrder(n);
+        return;
+    }
+
+    int iterations = (int) min<long long>(INT32_MAX, (long long) iterationsPerCity * (long long) n);
+    SimulatedAnnealingTSP annealing(graph,
+                                    iterations,
+                                    max(1, iterations / 5),
+                                    max(1, iterations / 10),
+                                    Temperature::PowerFast,
+                                    NextState::OrOpt);
+    annealing.setVerbose(false);
+    annealing.swapHistory(scratch.energyHistory, scratch.temperatureHistory);
+    annealing.annealAll();
+    annealing.swapHistory(scratch.energyHistory, scratch.temperatureHistory);
+    setResult(annealing.getBestState(), annealing.getBestE(), result);
+}
+
+void BatchRunner::setResult(const shared_ptr<PointGraph>& best, double length, Result& result) {
+    // The graph numbers the cities along its Hilbert curve
+    vector<int> positions = inverseOrder(best->getInstance()->getInputNumbers());
+    result.length = length;
+    result.tour = best->getOrder();
+    for(int& city: result.tour)
+        city = positions[city];
+}
+
+void BatchRunner::solveLockstep(vector<Job>& jobs, Scratch& scratch, vector<Result>& jobResults) const {
+    scratch.lanes.clear();
+    for(const auto& job: jobs)
+        scratch.lanes.push_back(&job.cities);
+    scratch.lockstep.run(scratch.lanes, iterationsPerCity);
+    for(size_t lane = 0; lane < jobs.size(); lane++)
+        jobResults.push_back(Result{jobs[lane].name, scratch.lockstep.getLength((int) lane),
+                                    scratch.lockstep.getTour((int) lane), true});
+}
+
+size_t BatchRunner::takeJobs(int worker, vector<Job>& jobs) {
+    jobs.clear();
+    for(int offset = 0; offset < threadsNumber; offset++) {
+        int victim = (worker + offset) % threadsNumber;
+        lock_guard<mutex> lock(queueMutexes[victim]);
+        deque<Job>& queue = queues[victim];
+        // The own deque is served oldest first, keeping the output flowing, and thieves take the newest instances
+        bool own = offset == 0;
+        while(!queue.empty() && jobs.size() < (size_t) LockstepAnnealingTSP::lanes) {
+            Job& next = own ? queue.front() : queue.back();
+            if(!jobs.empty() && !isPacked(next))
+                break;
+            jobs.push_back(move(next));
+            if(own)
+                queue.pop_front();
+            else
+                queue.pop_back();
+            if(!isPacked(jobs.back()))
+                break;
+        }
+        if(!jobs.empty())
+            return jobs.size();
+    }
+    return 0;
+}
+
+void BatchRunner::runWorker(int worker, ostream& out) {
+    Scratch scratch{vector<double>(), vector<double>(), LockstepAnnealingTSP(metric), vector<const vector<Point>*>()};
+    vector<Job> jobs;
+    vector<Result> jobResults;
+    while(true) {
+        if(size_t taken = takeJobs(worker, jobs)) {
+            {
+                lock_guard<mutex> lock(poolMutex);
+                queued -= taken;
+            }
+            spaceAvailable.notify_one();
+
+            jobResults.clear();
+            if(isPacked(jobs[0]))
+                solveLockstep(jobs, scratch, jobResults);
+            else {
+                jobResults.push_back(Result{jobs[0].name, 0., vector<int>(), true});
+                solve(jobs[0], scratch, jobResults[0]);
+            }
+            for(size_t j = 0; j < taken; j++)
+                finish(jobs[j].index, move(jobResults[j]), out);
+            continue;
+        }
+
+        unique_lock<mutex> lock(poolMutex);
+        if(queued == 0 && inputDone)
+            return;
+        jobsAvailable.wait(lock, [this]() { return queued > 0 || inputDone; });
+    }
+}
+
+void BatchRunner::finish(size_t index, Result&& result, ostream& out) {
+    lock_guard<mutex> lock(resultsMutex);
+    results[index - nextResult] = move(result);
+    while(!results.empty() && results.front().done) {
+        const Result& front = results.front();
+        out << front.name << ' ' << front.length;
+        for(int city: front.tour)
+            out << ' ' << city;
+        out << '\n';
+        results.pop_front();
+        nextResult++;
+    }
+    out.flush();
+}
+
+size_t BatchRunner::run(istream& in, ostream& out) {
+    queued = 0;
+    inputDone = false;
+    results.clear();
+    nextResult = 0;
+
+    vector<thread> workers;
+    for(int t = 0; t < threadsNumber; t++)
+        workers.emplace_back(&BatchRunner::runWorker, this, t, ref(out));
+
+    // Points are only made here, their label counter is not thread safe
+    size_t jobsNumber = 0;
+    Job job;
+    while(readJob(in, job)) {
+        job.index = jobsNumber;
+        {
+            lock_guard<mutex> lock(resultsMutex);
+            results.push_back(Result{job.name, 0., vector<int>(), false});
+        }
+        {
+            unique_lock<mutex> lock(poolMutex);
+            spaceAvailable.wait(lock, [this]() {
+                return queued < BatchRunner::maxQueuedPerThread * (size_t) threadsNumber;
+            });
+            lock_guard<mutex> queueLock(queueMutexes[jobsNumber % threadsNumber]);
+            queues[jobsNumber % threadsNumber].push_back(move(job));
+            queued++;
+        }
+        jobsAvailable.notify_one();
+        jobsNumber++;
+    }
+
+    {
+        lock_guard<mutex> lock(poolMutex);
+        inputDone = true;
+    }
+    jobsAvailable.notify_all();
+    for(auto& worker: workers)
+        worker.join();
+    return jobsNumber;
+}
@@ -0,0 +1,128 @@
+#ifndef SIMULATED_ANNEALING_BATCH_H
+#define SIMULATED_ANNEALING_BATCH_H
+
+/**
+ * @file batch.h
+ *
+ * @brief Batch runner annealing a stream of small instances on a work-stealing pool of threads.
+ *
+ * The manifest is a whitespace separated stream of instances, every one being a name and a number of cities n
+ * followed by the n coordinate pairs:
+ *
+ *     name n
+ *     x1 y1
+ *     ...
+ *
+ * The calling thread reads the manifest and deals the instances to the deques of the workers in turn, pausing
+ * while maxQueuedPerThread instances per worker wait. Every worker takes the oldest instance of its own deque,
+ * and once it is empty steals the newest one of another deque, so long instances do not hold up the rest.
+ * Instances are solved by SimulatedAnnealingTSP with a budget of iterations per city, and every worker keeps
+ * its history buffers between its instances. Instances of at most exactCities cities are solved exactly by
+ * HeldKarpTSP instead (see held_karp.h), which up to defaultExactCities is as fast as annealing them. With
+ * lockstep annealing on, a worker taking a larger instance of at most LockstepAnnealingTSP::maxCities cities
+ * also takes the following such instances of the same deque, up to one per lane, and anneals them together with
+ * its LockstepAnnealingTSP (see lockstep.h). Results are written in input order as soon as all the instances
+ * before them are done, one line per instance:
+ *
+ *     name length c1 c2 ... cn
+ *
+ * c being the positions of the cities in the input of the instance.
+ */
+
+#include <condition_variable>
+#include <deque>
+#include <vector>
+
+#include "annealing.h"
+#include "held_karp.h"
+#include "lockstep.h"
+
+
+using namespace std;
+
+
+
+class BatchRunner {
+private:
+    constexpr static size_t maxQueuedPerThread = 64;  // Number of waiting instances per worker pausing the reader
+    constexpr static size_t minAnnealedSize = 5;  // Smaller instances keep their input order
+
+    struct Job {
+        size_t index;  // Position of the instance in the manifest
+        string name;
+        vector<Point> cities;
+    };
+
+    struct Result {
+        string name;
+        double length;
+        vector<int> tour;  // Input positions of the cities in tour order
+        bool done;  // Whether the instance has been solved
+    };
+
+    // Buffers kept by a worker between its instances
+    struct Scratch {
+        vector<double> energyHistory;
+        vector<double> temperatureHistory;
+        LockstepAnnealingTSP lockstep;
+        vector<const vector<Point>*> lanes;  // Instances of the lockstep lanes
+    };
+
+    const int iterationsPerCity;  // Annealing budget of every instance, per city
+    const int threadsNumber;  // Number of workers
+    const DistanceMetric metric;  // Metric of every instance
+    const bool lockstep;  // Whether small instances are annealed together by LockstepAnnealingTSP
+    const size_t exactCities;  // Largest instance solved by HeldKarpTSP, 0 for none
+
+    vector<deque<Job>> queues;  // Instances dealt to every worker, the oldest at the front
+    vector<mutex> queueMutexes;  // Guard queues
+    size_t queued;  // Number of instances waiting in the queues
+    bool inputDone;  // Whether the reader has finished
+    mutex poolMutex;  // Guards queued and inputDone
+    condition_variable jobsAvailable;  // Notified when an instance is queued or the input ends
+    condition_variable spaceAvailable;  // Notified when an instance is taken
+
+    deque<Result> results;  // Results from index nextResult on, the front one being written next
+    size_t nextResult;  // Index of the first result not written yet
+    mutex resultsMutex;  // Guards results, nextResult and the output
+
+    // Reads the next instance of the manifest, false at its end or on malformed input
+    static bool readJob(istream& in, Job& job);
+
+    [[nodiscard]] bool isExact(const Job& job) const { return job.cities.size() <= exactCities; }
+
+    [[nodiscard]] bool isPacked(const Job& job) const {
+        return lockstep && !isExact(job) && job.cities.size() >= minAnnealedSize
+               && job.cities.size() <= LockstepAnnealingTSP::maxCities;
+    }
+
+    // Stores the tour of best, numbered by the input positions, and its length
+    static void setResult(const shared_ptr<PointGraph>& best, double length, Result& result);
+
+    void solve(Job& job, Scratch& scratch, Result& result) const;
+
+    // Anneals up to LockstepAnnealingTSP::lanes small instances together
+    void solveLockstep(vector<Job>& jobs, Scratch& scratch, vector<Result>& jobResults) const;
+
+    // Takes an instance of the worker's own deque, or steals one, followed by the small instances next to it
+    // if it is small, returns the number of instances taken
+    size_t takeJobs(int worker, vector<Job>& jobs);
+
+    void runWorker(int worker, ostream& out);
+
+    // Stores a result and writes all the results now complete in input order
+    void finish(size_t index, Result&& result, ostream& out);
+
+public:
+    constexpr static int defaultIterationsPerCity = 1000;
+    constexpr static size_t defaultExactCities = 11;
+
+    explicit BatchRunner(int threads=1, int iterationsPerCity=defaultIterationsPerCity,
+                         DistanceMetric metric=DistanceMetric::Euclidean, bool lockstep=true,
+                         size_t exactCities=defaultExactCities);
+
+    // Solves every instance of the manifest, returns the number of instances solved
+    size_t run(istream& in, ostream& out);
+};
+
+#endif //SIMULATED_ANNEALING_BATCH_H
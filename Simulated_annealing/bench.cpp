@@ -0,0 +1,688 @@
+/**
+ * @file bench.cpp
+ *
+ * @brief Micro and macro benchmarks of the annealing engine.
+ *
+ * Micro-benchmarks time single kernels: tour length (full and cached), every move type, RNG draws
+ * and the acceptance test. Macro runs time annealAll() on fixed-seed uniform, normal and clustered
+ * instances and compare the final tour with a local search + Lin-Kernighan reference. Every result
+ * reports iterations/sec, ns/iteration and heap allocations/iteration, and all of them are written
+ * to a JSON file so that regressions can be tracked over time.
+ *
+ * Usage: Simulated_annealing_bench [--json FILE] [--sizes N,N,...] [--iterations K] [--micro-size N]
+ *                                  [--reference-time SECONDS] [--metric euclidean|rounded]
+ *                                  [--precision double,single] [--rejection-free RATE]
+ *                                  [--acceptance metropolis,threshold,deluge,record,late]
+ *                                  [--adaptive] [--move-range MIN[,WINDOW]] [--hilbert] [--domains P,P,...]
+ *                                  [--speculative P,P,...] [--multilevel P] [--clusters SIZE[,P]] [--grid]
+ *                                  [--batch COUNT[,P,P,...]] [--batch-sizes MIN,MAX] [--no-lockstep]
+ *                                  [--exact-cities K] [--no-micro] [--no-macro]
+ *
+ * Every precision and acceptance rule given to --precision and --acceptance gets its own macro runs,
+ * so their speed and gap can be compared on the same instances. Macro runs use Or-opt moves, or the
+ * adaptive operator selection with --adaptive, whose per-operator stats are printed after each run.
+ * --move-range shrinks the moves with the temperature (see SimulatedAnnealingTSP::setMoveRange()), and
+ * --hilbert starts the annealing from the instance sorted along a Hilbert curve. Every thread count given
+ * to --domains or --speculative gets its own macro run with that parallel annealing, reporting its speedup
+ * over the single chain run of the same instance (and the conflict rate of the speculative moves).
+ * Multi-start on P threads runs P chains in the time of one, so a parallel run wins over it wherever
+ * its speedup exceeds 1 at a comparable gap. --multilevel adds a run of the coarsen-solve-refine pipeline
+ * (see multilevel.h) with P refinement threads and the same iteration budget. --clusters adds a run of the
+ * cluster-decompose, solve and stitch pipeline (see clusters.h) with clusters of about SIZE cities solved on
+ * P threads, partitioned by k-means, or by a grid with --grid. --batch runs COUNT instances of MIN to MAX
+ * (20 to 500) uniform cities through the batch runner (see batch.h) on every thread count P, reporting
+ * instances/sec. Instances of at most K (11) cities are solved exactly (see held_karp.h), K = 0 disabling it, and
+ * larger instances of at most 128 cities are annealed in lockstep (see lockstep.h) unless --no-lockstep.
+ */
+
+#include "annealing.h"
+#include "batch.h"
+#include "clusters.h"
+#include "lin_kernighan.h"
+#include "local_search.h"
+#include "multilevel.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+
+
+using namespace std;
+
+
+
+// Every heap allocation of the process is counted, so the benchmarks can report allocations per iteration. The
+// standard library forwards the array and nothrow forms to the ones replaced here. None of them is inlined, or GCC
+// sees the malloc() of new reach delete and reports a mismatch.
+
+static atomic<long long> allocationsCount{0};
+
+[[gnu::noinline]] void* operator new(size_t size) {
+    allocationsCount.fetch_add(1, memory_order_relaxed);
+    if(void* ptr = malloc(size == 0 ? 1 : size))
+        return ptr;
+    throw bad_alloc();
+}
+
+[[gnu::noinline]] void* operator new(size_t size, align_val_t alignment) {
+    allocationsCount.fetch_add(1, memory_order_relaxed);
+    // aligned_alloc takes a multiple of the alignment
+    size_t aligned = ((size == 0 ? 1 : size) + (size_t) alignment - 1) / (size_t) alignment * (size_t) alignment;
+    if(void* ptr = aligned_alloc((size_t) alignment, aligned))
+        return ptr;
+    throw bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+[[gnu::noinline]] void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+[[gnu::noinline]] void operator delete(void* ptr, align_val_t) noexcept {
+    free(ptr);
+}
+
+[[gnu::noinline]] void operator delete(void* ptr, size_t, align_val_t) noexcept {
+    free(ptr);
+}
+
+
+
+struct BenchResult {
+    string group;  // "micro" or "macro"
+    string name;  // Measured kernel or engine configuration
+    string instance;  // Instance kind
+    size_t n;  // Number of cities
+    long long iterations;  // Number of measured iterations
+    double seconds;  // Wall time of the measured iterations
+    long long allocations;  // Heap allocations made by the measured iterations
+    double finalLength;  // Best tour length found (macro runs only)
+    double referenceLength;  // Reference tour length (macro runs only)
+    double maxDrift;  // Largest drift of the incrementally tracked energy (macro runs only)
+    double conflictRate = 0.;  // Share of conflicting claims (speculative macro runs only)
+    double speedup = 0.;  // Time of the single chain run over the time of this one (parallel macro runs only)
+    double instancesPerSecond = 0.;  // Throughput (batch runs only)
+};
+
+
+// Engine options of a macro run
+struct MacroConfig {
+    DistanceMetric metric;
+    Precision precision;
+    Acceptance acceptance;
+    double rejectionFreeRate;  // 0 disables the rejection-free phase
+    bool adaptive;  // NextState::Adaptive instead of NextState::OrOpt
+    size_t minMoveRange;  // 0 leaves the moves unlimited
+    size_t moveWindow;  // 0 draws moves from the whole tour
+    bool hilbert;  // Whether the instance is sorted along a Hilbert curve before annealing
+    Parallelism parallelism;  // Parallel annealing of the tour
+    int parallelThreads;  // Number of threads of the parallel annealing
+
+    [[nodiscard]] string getName() const;
+};
+
+
+class Benchmark {
+private:
+    constexpr static double minMicroSeconds = 0.2;  // Minimal wall time of one micro-benchmark
+    constexpr static mt19937::result_type instanceSeed = 20210601;  // Seed of every generated instance
+    constexpr static double side = 1000.;  // Instances are generated in [0, side] x [0, side]
+
+    static volatile double sink;  // Keeps benchmarked results alive
+
+public:
+    static PointGraph makeInstance(const string& kind, size_t n);
+
+    // Runs kernel in doubling batches until minMicroSeconds have passed
+    template<typename Kernel>
+    static BenchResult measure(const string& name, size_t n, Kernel kernel);
+
+    static vector<BenchResult> runMicro(size_t n);
+
+    // Local search followed by Lin-Kernighan, from the tour along the Hilbert curve: from the random input order
+    // long edges between clusters survived both and left a reference the annealing beat on clustered instances
+    static double getReferenceLength(const PointGraph& instance, double referenceTime);
+
+    static BenchResult runMacro(const string& kind, size_t n, int iterations, double referenceTime,
+                                const MacroConfig& config);
+
+    static BenchResult runMultilevel(const string& kind, size_t n, int iterations, double referenceTime,
+                                     DistanceMetric metric, int threads);
+
+    static BenchResult runClusters(const string& kind, size_t n, int iterations, double referenceTime,
+                                   DistanceMetric metric, size_t clusterSize, int threads, Partition partition);
+
+    static BenchResult runBatch(size_t count, size_t minSize, size_t maxSize, int threads, DistanceMetric metric,
+                                bool lockstep, size_t exactCities);
+
+    static void print(const BenchResult& result);
+
+    static void writeJson(const string& path, const vector<BenchResult>& results);
+};
+
+volatile double Benchmark::sink = 0.;
+
+
+const pair<string, Acceptance> acceptanceRules[] = {
+        {"Metropolis", Acceptance::Metropolis},
+        {"ThresholdAccepting", Acceptance::ThresholdAccepting},
+        {"GreatDeluge", Acceptance::GreatDeluge},
+        {"RecordToRecord", Acceptance::RecordToRecord},
+        {"LateAcceptance", Acceptance::LateAcceptance}
+};
+
+string MacroConfig::getName() const {
+    string name = adaptive ? "annealAll/PowerFast/Adaptive" : "annealAll/PowerFast/OrOpt";
+    if(metric == DistanceMetric::Rounded)
+        name += "/Rounded";
+    if(precision == Precision::Single)
+        name += "/Single";
+    for(const auto& rule: acceptanceRules)
+        if(acceptance != Acceptance::Metropolis && rule.second == acceptance)
+            name += "/" + rule.first;
+    if(rejectionFreeRate > 0.)
+        name += "/RejectionFree";
+    if(minMoveRange > 0)
+        name += "/MoveRange";
+    if(moveWindow > 0)
+        name += "/Window";
+    if(hilbert)
+        name += "/Hilbert";
+    if(parallelism == Parallelism::Domains)
+        name += "/Domains" + to_string(parallelThreads);
+    if(parallelism == Parallelism::Speculative)
+        name += "/Speculative" + to_string(parallelThreads);
+    return name;
+}
+
+
+PointGraph Benchmark::makeInstance(const string& kind, size_t n) {
+    PointGraph graph;
+    if(kind == "normal") {
+        auto randGenX = RandomDoubleGenerator(0., side, side / 2., side / 6., instanceSeed);
+        auto randGenY = RandomDoubleGenerator(0., side, side / 2., side / 6., instanceSeed + 1);
+        graph.initGraphNormal(randGenX, randGenY, n);
+    }
+    else if(kind == "clustered") {
+        auto randGenX = RandomDoubleGenerator(0., side, 0., side / 100., instanceSeed);
+        auto randGenY = RandomDoubleGenerator(0., side, 0., side / 100., instanceSeed + 1);
+        graph.initGraphClustered(randGenX, randGenY, n, max<size_t>(1, n / 256));
+    }
+    else {
+        auto randGenX = RandomDoubleGenerator(0., side, 0., 0., instanceSeed);
+        auto randGenY = RandomDoubleGenerator(0., side, 0., 0., instanceSeed + 1);
+        graph.initGraphUniform(randGenX, randGenY, n);
+    }
+    return graph;
+}
+
+template<typename Kernel>
+BenchResult Benchmark::measure(const string& name, size_t n, Kernel kernel) {
+    long long batch = 1, iterations = 0, allocations = 0;
+    double seconds = 0.;
+    while(seconds < minMicroSeconds) {
+        long long allocationsBefore = allocationsCount.load();
+        auto start = chrono::steady_clock::now();
+        for(long long i = 0; i < batch; i++)
+            kernel();
+        seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        allocations += allocationsCount.load() - allocationsBefore;
+        iterations += batch;
+        batch *= 2;
+    }
+    return BenchResult{"micro", name, "uniform", n, iterations, seconds, allocations, 0., 0., 0.};
+}
+
+vector<BenchResult> Benchmark::runMicro(size_t n) {
+    vector<BenchResult> results;
+    PointGraph graph = makeInstance("uniform", n);
+
+    results.push_back(measure("computeTotalDistance", n, [&]() { sink = graph.computeTotalDistance(); }));
+    results.push_back(measure("getTotalDistance", n, [&]() { sink = graph.getTotalDistance(); }));
+    results.push_back(measure("consecutiveSwap", n, [&]() { graph.consecutiveSwap(); }));
+    results.push_back(measure("arbitrarySwap", n, [&]() { graph.arbitrarySwap(); }));
+    results.push_back(measure("randomOrOpt", n, [&]() { sink = graph.randomOrOpt().delta; }));
+    results.push_back(measure("randomSegmentInsertion", n, [&]() { sink = graph.randomSegmentInsertion().delta; }));
+    results.push_back(measure("randomTwoOpt", n, [&]() { sink = graph.randomTwoOpt().delta; }));
+
+    // The same moves with endpoints at most defaultMinMoveRange positions apart
+    PointGraph local = graph;
+    local.setMoveRange(SimulatedAnnealingTSP::defaultMinMoveRange);
+    results.push_back(measure("arbitrarySwap/Range", n, [&]() { local.arbitrarySwap(); }));
+    results.push_back(measure("randomOrOpt/Range", n, [&]() { sink = local.randomOrOpt().delta; }));
+    results.push_back(measure("randomTwoOpt/Range", n, [&]() { sink = local.randomTwoOpt().delta; }));
+
+    PointGraph rounded = graph;
+    rounded.setDistanceMetric(DistanceMetric::Rounded);
+    results.push_back(measure("computeTotalDistance/Rounded", n, [&]() { sink = rounded.computeTotalDistance(); }));
+    results.push_back(measure("randomOrOpt/Rounded", n, [&]() { sink = rounded.randomOrOpt().delta; }));
+
+    PointGraph single = graph;
+    single.setPrecision(Precision::Single);
+    results.push_back(measure("computeTotalDistance/Single", n, [&]() { sink = single.computeTotalDistance(); }));
+    results.push_back(measure("arbitrarySwap/Single", n, [&]() { single.arbitrarySwap(); }));
+    results.push_back(measure("randomOrOpt/Single", n, [&]() { sink = single.randomOrOpt().delta; }));
+
+    // Mixed neighbourhood: ten arbitrary swaps, evaluated together
+    SwapMove swaps[PointGraph::maxBatchSize];
+    results.push_back(measure("randomSwapBatch/10", n, [&]() {
+        graph.randomSwapBatch(swaps, 10);
+        sink = swaps[0].delta;
+    }));
+    results.push_back(measure("randomSwapBatch/10/Single", n, [&]() {
+        single.randomSwapBatch(swaps, 10);
+        sink = swaps[0].delta;
+    }));
+
+    // One proposal + evaluation + acceptance of the engine for every move type, at half the initial temperature
+    const pair<string, NextState> moveTypes[] = {
+            {"Consecutive", NextState::Consecutive},
+            {"Arbitrary", NextState::Arbitrary},
+            {"Mixed", NextState::Mixed},
+            {"OrOpt", NextState::OrOpt},
+            {"SegmentInsertion", NextState::SegmentInsertion},
+            {"MixedBatch", NextState::MixedBatch},
+            {"TwoOpt", NextState::TwoOpt},
+            {"Adaptive", NextState::Adaptive}
+    };
+    for(const auto& moveType: moveTypes) {
+        SimulatedAnnealingTSP annealing(make_shared<PointGraph>(graph), 1000, 1000, 0, Temperature::Linear,
+                                        moveType.second);
+        annealing.setTemperature(SimulatedAnnealingTSP::initialT / 2.);
+        results.push_back(measure("makeMove/" + moveType.first, n, [&]() { annealing.makeMove(); }));
+    }
+
+    auto randDoubleGen = RandomDoubleGenerator(0., 1., 0.5, 0., instanceSeed);
+    auto randIntGen = RandomIntGenerator(0, (int) n - 1, instanceSeed);
+    results.push_back(measure("rng/uniformDouble", n, [&]() { sink = randDoubleGen.getRandomUniform(); }));
+    results.push_back(measure("rng/uniformInt", n, [&]() { sink = randIntGen.getRandomUniform(); }));
+    results.push_back(measure("rng/uniformIntRange", n, [&]() { sink = randIntGen.getRandomUniform(0, (int) n - 1); }));
+
+    // Test of an uphill candidate, for every acceptance rule
+    for(const auto& rule: acceptanceRules) {
+        SimulatedAnnealingTSP annealing(make_shared<PointGraph>(graph), 1000, 1000, 0, Temperature::Linear,
+                                        NextState::Consecutive, HillDescent::LocalSearch, rule.second);
+        annealing.setTemperature(SimulatedAnnealingTSP::initialT / 2.);
+        double delta = 0.;
+        results.push_back(measure("acceptance/" + rule.first, n, [&]() {
+            delta = delta > 1000. ? 0. : delta + 1.;
+            sink = annealing.accepts(annealing.getE() + delta);
+        }));
+    }
+
+    return results;
+}
+
+double Benchmark::getReferenceLength(const PointGraph& instance, double referenceTime) {
+    PointGraph start = instance;
+    start.sortAlongHilbertCurve();
+    LocalSearchTSP localSearch(start);
+    localSearch.run();
+    LinKernighanTSP linKernighan(localSearch.getGraph(), referenceTime);
+    linKernighan.run();
+    return linKernighan.getLength();
+}
+
+BenchResult Benchmark::runMacro(const string& kind, size_t n, int iterations, double referenceTime,
+                                const MacroConfig& config) {
+    PointGraph instance = makeInstance(kind, n);
+    instance.setDistanceMetric(config.metric);
+    double referenceLength = getReferenceLength(instance, referenceTime);
+
+    instance.setPrecision(config.precision);
+    if(config.hilbert)
+        instance.sortAlongHilbertCurve();
+    SimulatedAnnealingTSP annealing(make_shared<PointGraph>(instance),
+                                    iterations,
+                                    max(1, iterations / 5),
+                                    max(1, iterations / 10),
+                                    Temperature::PowerFast,
+                                    config.adaptive ? NextState::Adaptive : NextState::OrOpt,
+                                    HillDescent::LocalSearch,
+                                    config.acceptance);
+    annealing.setVerbose(false);
+    annealing.setResync(max(1, iterations / 10), max(1, (int) thread::hardware_concurrency()));
+    annealing.setRejectionFree(config.rejectionFreeRate);
+    annealing.setMoveRange(config.minMoveRange, config.moveWindow);
+    annealing.setParallelism(config.parallelism, config.parallelThreads);
+
+    long long allocationsBefore = allocationsCount.load();
+    auto start = chrono::steady_clock::now();
+    annealing.annealAll();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    long long allocations = allocationsCount.load() - allocationsBefore;
+    if(config.adaptive)
+        annealing.printOperatorStats(cout);
+
+    return BenchResult{"macro", config.getName(), kind, n, iterations, seconds, allocations,
+                       annealing.getBestE(), referenceLength, annealing.getMaxDrift(), annealing.getConflictRate(), 0.};
+}
+
+BenchResult Benchmark::runMultilevel(const string& kind, size_t n, int iterations, double referenceTime,
+                                     DistanceMetric metric, int threads) {
+    PointGraph instance = makeInstance(kind, n);
+    instance.setDistanceMetric(metric);
+    double referenceLength = getReferenceLength(instance, referenceTime);
+
+    MultilevelTSP multilevel(instance, threads);
+    long long allocationsBefore = allocationsCount.load();
+    auto start = chrono::steady_clock::now();
+    multilevel.run(iterations);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    long long allocations = allocationsCount.load() - allocationsBefore;
+
+    string name = "multilevel/Levels" + to_string(multilevel.getLevelsNumber()) + "/Domains" + to_string(threads);
+    if(metric == DistanceMetric::Rounded)
+        name += "/Rounded";
+    return BenchResult{"macro", name, kind, n, iterations, seconds, allocations, multilevel.getLength(),
+                       referenceLength, 0., 0., 0.};
+}
+
+BenchResult Benchmark::runClusters(const string& kind, size_t n, int iterations, double referenceTime,
+                                   DistanceMetric metric, size_t clusterSize, int threads, Partition partition) {
+    PointGraph instance = makeInstance(kind, n);
+    instance.setDistanceMetric(metric);
+    double referenceLength = getReferenceLength(instance, referenceTime);
+
+    long long allocationsBefore = allocationsCount.load();
+    auto start = chrono::steady_clock::now();
+    ClusterTSP clusters(instance, clusterSize, threads, partition);
+    clusters.run(iterations);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    long long allocations = allocationsCount.load() - allocationsBefore;
+
+    string name = string("clusters/") + (partition == Partition::Grid ? "Grid" : "KMeans") + "/Clusters"
+                  + to_string(clusters.getClustersNumber()) + "/Threads" + to_string(threads);
+    if(metric == DistanceMetric::Rounded)
+        name += "/Rounded";
+    return BenchResult{"macro", name, kind, n, iterations, seconds, allocations, clusters.getLength(),
+                       referenceLength, 0., 0., 0.};
+}
+
+BenchResult Benchmark::runBatch(size_t count, size_t minSize, size_t maxSize, int threads, DistanceMetric metric,
+                                bool lockstep, size_t exactCities) {
+    mt19937 gen(instanceSeed);
+    uniform_real_distribution<double> coordinate(0., side);
+    stringstream manifest;
+    manifest.precision(10);
+    size_t cities = 0;
+    for(size_t i = 0; i < count; i++) {
+        size_t n = minSize + gen() % (maxSize - minSize + 1);
+        manifest << "instance" << i << ' ' << n << '\n';
+        for(size_t c = 0; c < n; c++)
+            manifest << coordinate(gen) << ' ' << coordinate(gen) << '\n';
+        cities += n;
+    }
+
+    BatchRunner runner(threads, BatchRunner::defaultIterationsPerCity, metric, lockstep, exactCities);
+    stringstream output;
+    long long allocationsBefore = allocationsCount.load();
+    auto start = chrono::steady_clock::now();
+    size_t solved = runner.run(manifest, output);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    long long allocations = allocationsCount.load() - allocationsBefore;
+
+    // Every output line starts with the name and the length of an instance
+    double totalLength = 0.;
+    string name;
+    double length;
+    for(string line; getline(output, line);) {
+        stringstream fields(line);
+        if(fields >> name >> length)
+            totalLength += length;
+    }
+
+    string runName = "batch/Instances" + to_string(solved) + "/Sizes" + to_string(minSize) + "-" + to_string(maxSize)
+                     + "/Threads" + to_string(threads) + (lockstep ? "/Lockstep" : "")
+                     + (exactCities > 0 ? "/Exact" + to_string(exactCities) : "");
+    if(metric == DistanceMetric::Rounded)
+        runName += "/Rounded";
+    long long iterations = (long long) BatchRunner::defaultIterationsPerCity * (long long) cities;
+    return BenchResult{"batch", runName, "uniform", cities, iterations, seconds, allocations, totalLength, 0., 0., 0.,
+                       0., (double) solved / seconds};
+}
+
+void Benchmark::print(const BenchResult& result) {
+    cout << result.group << ' ' << result.name << " [" << result.instance << ", n=" << result.n << "]: "
+         << (double) result.iterations / result.seconds << " it/s, "
+         << result.seconds * 1e9 / (double) result.iterations << " ns/it, "
+         << (double) result.allocations / (double) result.iterations << " alloc/it";
+    if(result.group == "macro")
+        cout << ", length " << result.finalLength << ", gap "
+             << 100. * (result.finalLength - result.referenceLength) / result.referenceLength << "%, max drift "
+             << result.maxDrift;
+    if(result.group == "batch")
+        cout << ", " << result.instancesPerSecond << " instances/s, total length " << result.finalLength;
+    if(result.speedup > 0.)
+        cout << ", speedup " << result.speedup << "x";
+    if(result.conflictRate > 0.)
+        cout << ", conflict rate " << result.conflictRate;
+    cout << endl;
+}
+
+void Benchmark::writeJson(const string& path, const vector<BenchResult>& results) {
+    ofstream out(path);
+    out.precision(10);
+    out << "{\n  \"timestamp\": "
+        << chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count()
+        << ",\n  \"results\": [";
+    for(size_t i = 0; i < results.size(); i++) {
+        const BenchResult& result = results[i];
+        out << (i == 0 ? "\n" : ",\n") << "    {"
+            << "\"group\": \"" << result.group << "\", "
+            << "\"name\": \"" << result.name << "\", "
+            << "\"instance\": \"" << result.instance << "\", "
+            << "\"n\": " << result.n << ", "
+            << "\"iterations\": " << result.iterations << ", "
+            << "\"seconds\": " << result.seconds << ", "
+            << "\"iterations_per_sec\": " << (double) result.iterations / result.seconds << ", "
+            << "\"ns_per_iteration\": " << result.seconds * 1e9 / (double) result.iterations << ", "
+            << "\"allocations_per_iteration\": " << (double) result.allocations / (double) result.iterations;
+        if(result.group == "macro")
+            out << ", \"final_length\": " << result.finalLength
+                << ", \"reference_length\": " << result.referenceLength
+                << ", \"gap\": " << (result.finalLength - result.referenceLength) / result.referenceLength
+                << ", \"max_drift\": " << result.maxDrift
+                << ", \"conflict_rate\": " << result.conflictRate
+                << ", \"speedup\": " << result.speedup;
+        if(result.group == "batch")
+            out << ", \"total_length\": " << result.finalLength
+                << ", \"instances_per_sec\": " << result.instancesPerSecond
+                << ", \"speedup\": " << result.speedup;
+        out << '}';
+    }
+    out << "\n  ]\n}\n";
+}
+
+
+int main(int argc, char* argv[]) {
+    string jsonPath = "bench_results.json";
+    vector<size_t> sizes{1000, 10000, 100000};
+    int iterations = 1000000;
+    size_t microSize = 10000;
+    double referenceTime = 10.;
+    DistanceMetric metric = DistanceMetric::Euclidean;
+    vector<Precision> precisions{Precision::Double};
+    double rejectionFreeRate = 0.;
+    vector<Acceptance> acceptances{Acceptance::Metropolis};
+    bool adaptive = false;
+    size_t minMoveRange = 0, moveWindow = 0;
+    bool hilbert = false;
+    vector<pair<Parallelism, int>> parallelRuns{{Parallelism::None, 1}};  // The single chain run comes first
+    int multilevelThreads = 0;
+    size_t clusterSize = 0;
+    int clusterThreads = 1;
+    Partition partition = Partition::KMeans;
+    size_t batchCount = 0;
+    vector<int> batchThreads;
+    size_t batchMinSize = 20, batchMaxSize = 500;
+    bool lockstep = true;
+    size_t exactCities = BatchRunner::defaultExactCities;
+    bool micro = true, macro = true;
+
+    for(int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(arg == "--json" && hasValue)
+            jsonPath = argv[++i];
+        else if(arg == "--sizes" && hasValue) {
+            sizes.clear();
+            stringstream list(argv[++i]);
+            string size;
+            while(getline(list, size, ','))
+                sizes.push_back(stoul(size));
+        }
+        else if(arg == "--iterations" && hasValue)
+            iterations = stoi(argv[++i]);
+        else if(arg == "--micro-size" && hasValue)
+            microSize = stoul(argv[++i]);
+        else if(arg == "--reference-time" && hasValue)
+            referenceTime = stod(argv[++i]);
+        else if(arg == "--metric" && hasValue)
+            metric = string(argv[++i]) == "rounded" ? DistanceMetric::Rounded : DistanceMetric::Euclidean;
+        else if(arg == "--precision" && hasValue) {
+            precisions.clear();
+            stringstream list(argv[++i]);
+            string precision;
+            while(getline(list, precision, ','))
+                precisions.push_back(precision == "single" ? Precision::Single : Precision::Double);
+        }
+        else if(arg == "--rejection-free" && hasValue)
+            rejectionFreeRate = stod(argv[++i]);
+        else if(arg == "--acceptance" && hasValue) {
+            acceptances.clear();
+            stringstream list(argv[++i]);
+            string rule;
+            while(getline(list, rule, ','))
+                acceptances.push_back(rule == "threshold" ? Acceptance::ThresholdAccepting :
+                                      rule == "deluge" ? Acceptance::GreatDeluge :
+                                      rule == "record" ? Acceptance::RecordToRecord :
+                                      rule == "late" ? Acceptance::LateAcceptance : Acceptance::Metropolis);
+        }
+        else if(arg == "--adaptive")
+            adaptive = true;
+        else if(arg == "--move-range" && hasValue) {
+            stringstream list(argv[++i]);
+            string value;
+            if(getline(list, value, ','))
+                minMoveRange = stoul(value);
+            if(getline(list, value, ','))
+                moveWindow = stoul(value);
+        }
+        else if(arg == "--hilbert")
+            hilbert = true;
+        else if((arg == "--domains" || arg == "--speculative") && hasValue) {
+            stringstream list(argv[++i]);
+            string threads;
+            while(getline(list, threads, ','))
+                parallelRuns.emplace_back(arg == "--domains" ? Parallelism::Domains : Parallelism::Speculative,
+                                          stoi(threads));
+        }
+        else if(arg == "--multilevel" && hasValue)
+            multilevelThreads = stoi(argv[++i]);
+        else if(arg == "--clusters" && hasValue) {
+            stringstream list(argv[++i]);
+            string value;
+            if(getline(list, value, ','))
+                clusterSize = stoul(value);
+            if(getline(list, value, ','))
+                clusterThreads = stoi(value);
+        }
+        else if(arg == "--grid")
+            partition = Partition::Grid;
+        else if(arg == "--batch" && hasValue) {
+            stringstream list(argv[++i]);
+            string value;
+            if(getline(list, value, ','))
+                batchCount = stoul(value);
+            batchThreads.clear();
+            while(getline(list, value, ','))
+                batchThreads.push_back(stoi(value));
+            if(batchThreads.empty())
+                batchThreads.push_back(1);
+        }
+        else if(arg == "--batch-sizes" && hasValue) {
+            stringstream list(argv[++i]);
+            string value;
+            if(getline(list, value, ','))
+                batchMinSize = stoul(value);
+            if(getline(list, value, ','))
+                batchMaxSize = max(batchMinSize, (size_t) stoul(value));
+        }
+        else if(arg == "--no-lockstep")
+            lockstep = false;
+        else if(arg == "--exact-cities" && hasValue)
+            exactCities = stoul(argv[++i]);
+        else if(arg == "--no-micro")
+            micro = false;
+        else if(arg == "--no-macro")
+            macro = false;
+        else {
+            cerr << "Usage: " << argv[0] << " [--json FILE] [--sizes N,N,...] [--iterations K] [--micro-size N]"
+                 << " [--reference-time SECONDS] [--metric euclidean|rounded]"
+                 << " [--precision double,single] [--rejection-free RATE]"
+                 << " [--acceptance metropolis,threshold,deluge,record,late] [--adaptive]"
+                 << " [--move-range MIN[,WINDOW]] [--hilbert] [--domains P,P,...] [--speculative P,P,...]"
+                 << " [--multilevel P] [--clusters SIZE[,P]] [--grid] [--batch COUNT[,P,P,...]]"
+                 << " [--batch-sizes MIN,MAX] [--no-lockstep] [--exact-cities K] [--no-micro] [--no-macro]" << endl;
+            return 1;
+        }
+    }
+
+    vector<BenchResult> results;
+    if(micro)
+        for(const auto& result: Benchmark::runMicro(microSize)) {
+            Benchmark::print(result);
+            results.push_back(result);
+        }
+    if(macro)
+        for(const string kind: {"uniform", "normal", "clustered"})
+            for(size_t n: sizes) {
+                for(Precision precision: precisions)
+                    for(Acceptance acceptance: acceptances) {
+                        double singleChainSeconds = 0.;
+                        for(const auto& run: parallelRuns) {
+                            MacroConfig config{metric, precision, acceptance, rejectionFreeRate, adaptive,
+                                               minMoveRange, moveWindow, hilbert, run.first, run.second};
+                            results.push_back(Benchmark::runMacro(kind, n, iterations, referenceTime, config));
+                            if(run.first == Parallelism::None)
+                                singleChainSeconds = results.back().seconds;
+                            else
+                                results.back().speedup = singleChainSeconds / results.back().seconds;
+                            Benchmark::print(results.back());
+                        }
+                    }
+                if(multilevelThreads > 0) {
+                    results.push_back(Benchmark::runMultilevel(kind, n, iterations, referenceTime, metric,
+                                                               multilevelThreads));
+                    Benchmark::print(results.back());
+                }
+                if(clusterSize > 0) {
+                    results.push_back(Benchmark::runClusters(kind, n, iterations, referenceTime, metric,
+                                                             clusterSize, clusterThreads, partition));
+                    Benchmark::print(results.back());
+                }
+            }
+    if(batchCount > 0) {
+        double firstSeconds = 0.;
+        for(int threads: batchThreads) {
+            results.push_back(Benchmark::runBatch(batchCount, batchMinSize, batchMaxSize, threads, metric, lockstep,
+                                                  exactCities));
+            if(firstSeconds == 0.)
+                firstSeconds = results.back().seconds;
+            else
+                results.back().speedup = firstSeconds / results.back().seconds;
+            Benchmark::print(results.back());
+        }
+    }
+
+    Benchmark::writeJson(jsonPath, results);
+    cout << "Results written to " << jsonPath << endl;
+    return 0;
+}
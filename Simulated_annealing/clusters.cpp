@@ -0,0 +1,222 @@
+/**
+ * @file clusters.cpp
+ */
+
+#include "clusters.h"
+#include "local_search.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+
+// ClusterTSP
+
+ClusterTSP::ClusterTSP(const PointGraph& graph, size_t clusterSize, int threads, Partition partition):
+
+        instance{graph.getInstance()},
+        metric{graph.getDistanceMetric()},
+        representation{graph.getTourRepresentation()},
+        precision{graph.getPrecision()},
+        threads{max(1, threads)},
+        clusters{vector<vector<int>>()},
+        tour{graph.getOrder()},
+        length{0.}
+{
+    size_t n = instance->size();
+    size_t clustersNumber = max<size_t>(1, (n + max<size_t>(1, clusterSize) - 1) / max<size_t>(1, clusterSize));
+    if(n == 0)
+        return;
+    if(partition == Partition::KMeans)
+        partitionKMeans(min(clustersNumber, n));
+    else
+        partitionGrid(clustersNumber);
+}
+
+void ClusterTSP::partitionKMeans(size_t clustersNumber) {
+    const vector<Point>& cities = instance->getCities();
+    size_t n = cities.size();
+
+    // Initial centres are distinct cities drawn with the fixed seed
+    mt19937 gen(ClusterTSP::kMeansSeed);
+    vector<int> picks = identityOrder(n);
+    vector<pair<double, double>> centres;
+    for(size_t c = 0; c < clustersNumber; c++) {
+        swap(picks[c], picks[c + gen() % (n - c)]);
+        centres.emplace_back(cities[picks[c]].getX(), cities[picks[c]].getY());
+    }
+
+    vector<int> assignment(n, 0);
+    int workersNumber = max(1, min(threads, (int) (n / 65536)));
+    for(int iteration = 0; iteration < ClusterTSP::kMeansIterations; iteration++) {
+        // Assignment to the nearest centre, split between threads for large instances
+        auto assign = [&cities, &centres, &assignment](size_t from, size_t to) {
+            for(size_t i = from; i < to; i++) {
+                double bestDistance = -1.;
+                for(size_t c = 0; c < centres.size(); c++) {
+                    double dx = cities[i].getX() - centres[c].first, dy = cities[i].getY() - centres[c].second;
+                    double d = dx * dx + dy * dy;
+                    if(bestDistance < 0. || d < bestDistance) {
+                        bestDistance = d;
+                        assignment[i] = (int) c;
+                    }
+                }
+            }
+        };
+        if(workersNumber == 1)
+            assign(0, n);
+        else {
+            vector<thread> workers;
+            for(int t = 0; t < workersNumber; t++)
+                workers.emplace_back(assign, n * t / workersNumber, n * (t + 1) / workersNumber);
+            for(auto& worker: workers)
+                worker.join();
+        }
+
+        // Centres move to the mean of their cities, centres of empty clusters stay
+        vector<pair<double, double>> sums(clustersNumber, {0., 0.});
+        vector<size_t> counts(clustersNumber, 0);
+        for(size_t i = 0; i < n; i++) {
+            sums[assignment[i]].first += cities[i].getX();
+            sums[assignment[i]].second += cities[i].getY();
+            counts[assignment[i]]++;
+        }
+        for(size_t c = 0; c < clustersNumber; c++)
+            if(counts[c] > 0)
+                centres[c] = {sums[c].first / (double) counts[c], sums[c].second / (double) counts[c]};
+    }
+
+    clusters = vector<vector<int>>(clustersNumber);
+    for(size_t i = 0; i < n; i++)
+        clusters[assignment[i]].push_back((int) i);
+    clusters.erase(remove_if(clusters.begin(), clusters.end(),
+                             [](const vector<int>& cluster) { return cluster.empty(); }), clusters.end());
+}
+
+void ClusterTSP::partitionGrid(size_t clustersNumber) {
+    const vector<Point>& cities = instance->getCities();
+    size_t side = max<size_t>(1, (size_t) ceil(sqrt((double) clustersNumber)));
+
+    double minX = cities[0].getX(), maxX = minX;
+    double minY = cities[0].getY(), maxY = minY;
+    for(const auto& p: cities) {
+        minX = min(minX, p.getX());
+        maxX = max(maxX, p.getX());
+        minY = min(minY, p.getY());
+        maxY = max(maxY, p.getY());
+    }
+    double cellWidth = maxX > minX ? (maxX - minX) / (double) side : 1.;
+    double cellHeight = maxY > minY ? (maxY - minY) / (double) side : 1.;
+
+    clusters = vector<vector<int>>(side * side);
+    for(size_t i = 0; i < cities.size(); i++) {
+        size_t column = min(side - 1, (size_t) ((cities[i].getX() - minX) / cellWidth));
+        size_t row = min(side - 1, (size_t) ((cities[i].getY() - minY) / cellHeight));
+        clusters[row * side + column].push_back((int) i);
+    }
+    clusters.erase(remove_if(clusters.begin(), clusters.end(),
+                             [](const vector<int>& cluster) { return cluster.empty(); }), clusters.end());
+}
+
+vector<int> ClusterTSP::solve(const vector<Point>& points, int iterations) const {
+    if(points.size() < 5)
+        return identityOrder(points.size());
+
+    SimulatedAnnealingTSP annealing(make_shared<PointGraph>(points, representation, metric, precision),
+                                    iterations,
+                                    max(1, iterations / 5),
+                                    max(1, iterations / 10),
+                                    Temperature::PowerFast,
+                                    NextState::OrOpt);
+    annealing.setVerbose(false);
+    annealing.annealAll();
+
+    // The graph numbers the points along its own Hilbert curve
+    vector<int> pointIndices = inverseOrder(annealing.getBestState()->getInstance()->getInputNumbers());
+    vector<int> best = annealing.getBestState()->getOrder();
+    for(int& city: best)
+        city = pointIndices[city];
+    return best;
+}
+
+void ClusterTSP::run(int iterations) {
+    size_t n = instance->size(), k = clusters.size();
+    if(k == 0)
+        return;
+
+    // Clusters are taken from a shared counter, so threads finishing small clusters go on with the next ones
+    vector<vector<int>> clusterTours(k);
+    atomic<size_t> nextCluster{0};
+    auto solveClusters = [this, &clusterTours, &nextCluster, iterations, n, k]() {
+        for(size_t c = nextCluster++; c < k; c = nextCluster++) {
+            vector<Point> points;
+            points.reserve(clusters[c].size());
+            for(int city: clusters[c])
+                points.push_back(instance->getCity(city));
+            int clusterIterations = (int) max<long long>(1, (long long) iterations * (long long) points.size()
+                                                            / (long long) n);
+            for(int index: solve(points, clusterIterations))
+                clusterTours[c].push_back(clusters[c][index]);
+        }
+    };
+    int workersNumber = max(1, min(threads, (int) k));
+    if(workersNumber == 1)
+        solveClusters();
+    else {
+        vector<thread> workers;
+        for(int t = 0; t < workersNumber; t++)
+            workers.emplace_back(solveClusters);
+        for(auto& worker: workers)
+            worker.join();
+    }
+
+    vector<Point> centroids;
+    for(const auto& cluster: clusters) {
+        double x = 0., y = 0.;
+        for(int city: cluster) {
+            x += instance->getCity(city).getX();
+            y += instance->getCity(city).getY();
+        }
+        centroids.emplace_back(x / (double) cluster.size(), y / (double) cluster.size());
+    }
+    vector<int> clusterOrder = solve(centroids, ClusterTSP::orderIterationsPerCluster * (int) k);
+
+    // Every cluster tour is cut at one edge and entered at one of its ends, the cut minimising the edges
+    // to the exit of the previous cluster and towards the centroid of the next one
+    tour.clear();
+    for(size_t r = 0; r < k; r++) {
+        const vector<int>& clusterTour = clusterTours[clusterOrder[r]];
+        const Point& previous = r == 0 ? centroids[clusterOrder[k - 1]] : instance->getCity(tour.back());
+        const Point& next = centroids[clusterOrder[r + 1 == k ? 0 : r + 1]];
+        size_t m = clusterTour.size();
+
+        size_t bestEdge = 0;
+        bool bestForward = true;
+        double bestCost = 0.;
+        for(size_t j = 0; j < m; j++) {
+            int a = clusterTour[j], b = clusterTour[j + 1 == m ? 0 : j + 1];
+            double removed = m > 1 ? dist(a, b) : 0.;
+            const Point& pointA = instance->getCity(a);
+            const Point& pointB = instance->getCity(b);
+            // Forward enters at b and leaves at a, backward enters at a and leaves at b
+            double forward = previous.getDistanceTo(pointB, metric) + pointA.getDistanceTo(next, metric) - removed;
+            double backward = previous.getDistanceTo(pointA, metric) + pointB.getDistanceTo(next, metric) - removed;
+            if(j == 0 || min(forward, backward) < bestCost) {
+                bestEdge = j;
+                bestForward = forward <= backward;
+                bestCost = min(forward, backward);
+            }
+        }
+        for(size_t s = 0; s < m; s++)
+            tour.push_back(bestForward ? clusterTour[(bestEdge + 1 + s) % m] : clusterTour[(bestEdge + m - s) % m]);
+    }
+
+    LocalSearchTSP localSearch(PointGraph(instance, tour, representation, metric, precision));
+    localSearch.run();
+    tour = localSearch.getGraph().getOrder();
+    length = localSearch.getLength();
+}
+
+PointGraph ClusterTSP::getGraph() const {
+    return PointGraph(instance, tour, representation, metric, precision);
+}
@@ -0,0 +1,74 @@
+#ifndef SIMULATED_ANNEALING_CLUSTERS_H
+#define SIMULATED_ANNEALING_CLUSTERS_H
+
+/**
+ * @file clusters.h
+ *
+ * @brief Cluster-decompose, solve-in-parallel and stitch pipeline.
+ *
+ * Cities are partitioned into clusters of about clusterSize cities, by k-means with a fixed seed or by a
+ * grid over the bounding box. Every cluster is solved by its own SimulatedAnnealingTSP, the clusters
+ * being taken from a shared counter by a pool of threads, so wall time follows the cluster size rather
+ * than n. The order of the clusters is a small TSP through their centroids, solved the same way. The
+ * tours are stitched along that order: every cluster tour is opened at the edge whose removal and the
+ * edges to the previous cluster and towards the next one cost the least, and a local search over the
+ * whole tour then refines the seams.
+ */
+
+#include <vector>
+
+#include "annealing.h"
+
+
+using namespace std;
+
+
+
+// KMeans - Lloyd iterations from centres drawn with a fixed seed,
+// Grid - square cells over the bounding box, empty cells dropped.
+enum class Partition { KMeans, Grid };
+
+
+class ClusterTSP {
+private:
+    constexpr static int kMeansIterations = 10;  // Number of Lloyd iterations
+    constexpr static mt19937::result_type kMeansSeed = 20210601;  // Seed of the initial centres
+    constexpr static int orderIterationsPerCluster = 1000;  // Iterations of the cluster order TSP per cluster
+
+    shared_ptr<const Instance> instance;  // Cities of the input graph
+    DistanceMetric metric;  // Metric of the input graph
+    TourRepresentation representation;  // Passed on to getGraph()
+    Precision precision;  // Passed on to getGraph()
+    int threads;  // Number of clusters solved in parallel
+    vector<vector<int>> clusters;  // City numbers of every cluster, in curve order
+    vector<int> tour;  // Tour through the input cities, by city number
+    double length;  // Length of tour
+
+    [[nodiscard]] double dist(int a, int b) const {
+        return instance->getCity(a).getDistanceTo(instance->getCity(b), metric);
+    }
+
+    void partitionKMeans(size_t clustersNumber);
+
+    void partitionGrid(size_t clustersNumber);
+
+    // Anneals a tour through points starting from their order, returns the best tour found as indices of points
+    [[nodiscard]] vector<int> solve(const vector<Point>& points, int iterations) const;
+
+public:
+    constexpr static size_t defaultClusterSize = 5000;
+
+    explicit ClusterTSP(const PointGraph& graph, size_t clusterSize=defaultClusterSize, int threads=1,
+                        Partition partition=Partition::KMeans);
+
+    // Splits the iterations between the clusters in proportion to their size
+    void run(int iterations);
+
+    [[nodiscard]] size_t getClustersNumber() const { return clusters.size(); }
+
+    [[nodiscard]] double getLength() const { return length; }
+
+    [[nodiscard]] PointGraph getGraph() const;
+};
+
+#endif //SIMULATED_ANNEALING_CLUSTERS_H
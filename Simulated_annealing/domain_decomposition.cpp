@@ -0,0 +1,155 @@
+/**
+ * @file domain_decomposition.cpp
+ */
+
+#include "domain_decomposition.h"
+
+#include <algorithm>
+
+
+// DomainAnnealingTSP
+
+DomainAnnealingTSP::DomainAnnealingTSP(const PointGraph& graph, int threads):
+
+        instance{graph.getInstance()},
+        metric{graph.getDistanceMetric()},
+        representation{graph.getTourRepresentation()},
+        precision{graph.getPrecision()},
+        regionsNumber{max(1, min(threads, (int) (graph.size() / DomainAnnealingTSP::minRegionLength)))},
+        order{graph.getOrder()},
+        paths{vector<vector<int>>(regionsNumber)},
+        generators{vector<mt19937>()},
+        regionDeltas{vector<double>(regionsNumber, 0.)},
+        regionAccepted{vector<long long>(regionsNumber, 0)},
+        offset{0},
+        length{CompensatedSum()},
+        bestLength{0.},
+        bestOrder{vector<int>()},
+        acceptedMoves{0},
+        epochs{0}
+{
+    random_device rd;
+    for(int r = 0; r < regionsNumber; r++)
+        generators.emplace_back(rd());
+
+    size_t n = order.size();
+    for(size_t i = 0; n > 1 && i < n; i++)
+        length.add(dist(order[i], order[i + 1 == n ? 0 : i + 1]));
+    bestLength = length.value();
+    bestOrder = order;
+}
+
+void DomainAnnealingTSP::annealRegion(int region, double T, long long moves, size_t range) {
+    size_t n = order.size();
+    size_t first = (offset + n * region / regionsNumber) % n;
+    size_t m = n * (region + 1) / regionsNumber - n * region / regionsNumber;
+    regionDeltas[region] = 0.;
+    regionAccepted[region] = 0;
+    if(m < DomainAnnealingTSP::minRegionLength)
+        return;
+
+    vector<int>& path = paths[region];
+    path.resize(m);
+    for(size_t i = 0, position = first; i < m; i++, position = position + 1 == n ? 0 : position + 1)
+        path[i] = order[position];
+
+    mt19937& gen = generators[region];
+    uniform_real_distribution<double> uniform(0., 1.);
+    auto draw = [&gen](size_t count) { return uniform_int_distribution<size_t>(0, count - 1)(gen); };
+
+    // Positions 1 .. m - 2 move, the end cities keep the edges leading to the neighbouring regions
+    size_t inner = m - 2;
+    size_t reach = range == 0 ? inner : min(range, inner);
+    CompensatedSum delta;
+    long long accepted = 0;
+    for(long long move = 0; move < moves; move++) {
+        if(gen() & 1) {
+            // 2-opt reversing path[i, j]
+            size_t i = 1 + draw(inner - 1);
+            size_t j = i + 1 + draw(min(reach, m - 2 - i));
+            double change = dist(path[i - 1], path[j]) + dist(path[i], path[j + 1])
+                            - dist(path[i - 1], path[i]) - dist(path[j], path[j + 1]);
+            if(change < 0. || (T > 0. && uniform(gen) < exp(-change / T))) {
+                reverse(path.begin() + (long) i, path.begin() + (long) j + 1);
+                delta.add(change);
+                accepted++;
+            }
+            continue;
+        }
+
+        // Or-opt moving path[i, last] between path[after] and path[after + 1]
+        size_t segmentLength = 1 + draw(DomainAnnealingTSP::maxSegmentLength);
+        size_t i = 1 + draw(m - 1 - segmentLength);
+        size_t last = i + segmentLength - 1;
+        size_t from = i - 1 > reach ? i - 1 - reach : 0;
+        size_t to = min(m - 2, last + reach);
+        size_t after = from + draw(to - from + 1);
+        if(after + 1 >= i && after <= last)
+            continue;
+        bool reversed = (gen() & 1) != 0;
+
+        int p = path[i - 1], q = path[last + 1], x = path[after], y = path[after + 1];
+        int toX = reversed ? path[last] : path[i], toY = reversed ? path[i] : path[last];
+        double change = dist(p, q) + dist(x, toX) + dist(toY, y)
+                        - dist(p, path[i]) - dist(path[last], q) - dist(x, y);
+        if(change < 0. || (T > 0. && uniform(gen) < exp(-change / T))) {
+            size_t newFirst;
+            if(after > last) {
+                rotate(path.begin() + (long) i, path.begin() + (long) last + 1, path.begin() + (long) after + 1);
+                newFirst = after + 1 - segmentLength;
+            }
+            else {
+                rotate(path.begin() + (long) after + 1, path.begin() + (long) i, path.begin() + (long) last + 1);
+                newFirst = after + 1;
+            }
+            if(reversed)
+                reverse(path.begin() + (long) newFirst, path.begin() + (long) (newFirst + segmentLength));
+            delta.add(change);
+            accepted++;
+        }
+    }
+
+    for(size_t i = 0, position = first; i < m; i++, position = position + 1 == n ? 0 : position + 1)
+        order[position] = path[i];
+    regionDeltas[region] = delta.value();
+    regionAccepted[region] = accepted;
+}
+
+void DomainAnnealingTSP::runEpoch(double T, long long moves, size_t range) {
+    if(order.empty())
+        return;
+
+    if(regionsNumber == 1)
+        annealRegion(0, T, moves, range);
+    else {
+        // Regions cover disjoint positions and only read the shared instance, so they need no locking
+        vector<thread> workers;
+        for(int r = 0; r < regionsNumber; r++)
+            workers.emplace_back([this, r, T, moves, range]() {
+                annealRegion(r, T, moves * (r + 1) / regionsNumber - moves * r / regionsNumber, range);
+            });
+        for(auto& worker: workers)
+            worker.join();
+    }
+
+    for(int r = 0; r < regionsNumber; r++) {
+        length.add(regionDeltas[r]);
+        acceptedMoves += regionAccepted[r];
+    }
+    if(length.value() < bestLength) {
+        bestLength = length.value();
+        bestOrder = order;
+    }
+
+    // Half a region, so the edges around the old boundaries lie in the middle of the new regions
+    offset = (offset + max<size_t>(1, order.size() / (2 * regionsNumber))) % order.size();
+    epochs++;
+}
+
+PointGraph DomainAnnealingTSP::getGraph() const {
+    return PointGraph(instance, order, representation, metric, precision);
+}
+
+PointGraph DomainAnnealingTSP::getBestGraph() const {
+    return PointGraph(instance, bestOrder, representation, metric, precision);
+}
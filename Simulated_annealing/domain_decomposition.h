@@ -0,0 +1,79 @@
+#ifndef SIMULATED_ANNEALING_DOMAIN_DECOMPOSITION_H
+#define SIMULATED_ANNEALING_DOMAIN_DECOMPOSITION_H
+
+/**
+ * @file domain_decomposition.h
+ *
+ * @brief Parallel annealing of a single tour split into contiguous regions.
+ *
+ * Every epoch the tour is cut into one region of consecutive positions per thread. A thread anneals
+ * its region as a path whose two end cities stay in place, with 2-opt and Or-opt moves lying entirely
+ * inside it, so regions never share an edge and need no locking. The cities are read from the shared
+ * Instance, and each thread works on a private copy of its positions, written back when the epoch ends.
+ * Region boundaries then move by half a region, so the edges crossing a boundary in one epoch lie
+ * inside a region in the next. Acceptance is Metropolis at the temperature of the epoch.
+ */
+
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "annealing.h"
+
+
+using namespace std;
+
+
+
+class DomainAnnealingTSP {
+private:
+    constexpr static size_t minRegionLength = 8;  // Shorter regions have hardly any moves and are skipped
+    constexpr static int maxSegmentLength = 3;  // Longest segment relocated by Or-opt
+
+    shared_ptr<const Instance> instance;  // Cities of the input graph
+    DistanceMetric metric;  // Metric of the input graph
+    TourRepresentation representation;  // Passed on to getGraph()
+    Precision precision;  // Passed on to getGraph() (the regions are annealed in double)
+    int regionsNumber;  // Number of regions, one thread each
+    vector<int> order;  // City at every tour position
+    vector<vector<int>> paths;  // Scratch copy of the positions of every region
+    vector<mt19937> generators;  // Random engine of every region
+    vector<double> regionDeltas;  // Change of length caused by every region in the last epoch
+    vector<long long> regionAccepted;  // Moves accepted by every region in the last epoch
+    size_t offset;  // Position at which the first region starts
+    CompensatedSum length;  // Current tour length
+    double bestLength;  // Lowest tour length seen at the end of an epoch
+    vector<int> bestOrder;  // Tour of bestLength
+    long long acceptedMoves;  // Number of applied moves
+    long long epochs;  // Number of epochs run
+
+    [[nodiscard]] double dist(int a, int b) const {
+        return instance->getCity(a).getDistanceTo(instance->getCity(b), metric);
+    }
+
+    // Copies the positions of the region into its path, anneals it and writes it back
+    void annealRegion(int region, double T, long long moves, size_t range);
+
+public:
+    DomainAnnealingTSP(const PointGraph& graph, int threads);
+
+    // Runs moves Metropolis iterations at temperature T split evenly between the regions, in parallel.
+    // Moves reach at most range positions (0 for the whole region). Boundaries shift afterwards.
+    void runEpoch(double T, long long moves, size_t range=0);
+
+    [[nodiscard]] int getRegionsNumber() const { return regionsNumber; }
+
+    [[nodiscard]] double getLength() const { return length.value(); }
+
+    [[nodiscard]] double getBestLength() const { return bestLength; }
+
+    [[nodiscard]] long long getAcceptedMoves() const { return acceptedMoves; }
+
+    [[nodiscard]] long long getEpochs() const { return epochs; }
+
+    [[nodiscard]] PointGraph getGraph() const;
+
+    [[nodiscard]] PointGraph getBestGraph() const;
+};
+
+#endif //SIMULATED_ANNEALING_DOMAIN_DECOMPOSITION_H
@@ -0,0 +1,144 @@
+/**
+ * @file held_karp.cpp
+ */
+
+#include "held_karp.h"
+
+#include <limits>
+#include <thread>
+
+
+// HeldKarpTSP
+
+HeldKarpTSP::HeldKarpTSP(const shared_ptr<PointGraph>& pointGraph, int threads):
+
+        pointGraph{pointGraph},
+        threadsNumber{max(1, threads)},
+        verbose{true},
+        n{pointGraph->size()},
+        distances{vector<double>()},
+        costs{vector<double>()},
+        masks{vector<uint32_t>()},
+        layerStarts{vector<size_t>()},
+        bestE{pointGraph->getTotalDistance()},
+        bestState{make_shared<PointGraph>(*pointGraph)}
+{}
+
+void HeldKarpTSP::solveMasks(size_t from, size_t to) {
+    size_t m = n - 1;
+    int cities[HeldKarpTSP::maxCities];
+    for(size_t p = from; p < to; p++) {
+        uint32_t mask = masks[p];
+        int count = 0;
+        for(int j = 0; j < (int) m; j++)
+            if((mask >> j) & 1u)
+                cities[count++] = j;
+
+        // The entry of j in the row of mask without j is infinite, so the inner loop needs no test of i == j
+        double* row = &costs[(size_t) mask * m];
+        for(int a = 0; a < count; a++) {
+            int j = cities[a];
+            const double* previousRow = &costs[(size_t) (mask ^ (1u << j)) * m];
+            double best = numeric_limits<double>::infinity();
+            for(int b = 0; b < count; b++) {
+                int i = cities[b];
+                best = min(best, previousRow[i] + dist(i + 1, j + 1));
+            }
+            row[j] = best;
+        }
+    }
+}
+
+vector<int> HeldKarpTSP::buildTour() const {
+    size_t m = n - 1;
+    uint32_t mask = (1u << m) - 1;
+    int last = 0;
+    for(int j = 1; j < (int) m; j++)
+        if(costs[(size_t) mask * m + j] + dist(j + 1, 0) < costs[(size_t) mask * m + last] + dist(last + 1, 0))
+            last = j;
+
+    // Walks back from the last city, every step taking the predecessor the costs were computed from
+    vector<int> tour;
+    while(true) {
+        tour.push_back(last + 1);
+        uint32_t previous = mask ^ (1u << last);
+        if(previous == 0)
+            break;
+        int before = -1;
+        double bestCost = numeric_limits<double>::infinity();
+        for(int i = 0; i < (int) m; i++) {
+            double cost = costs[(size_t) previous * m + i] + dist(i + 1, last + 1);
+            if(((previous >> i) & 1u) && cost < bestCost) {
+                bestCost = cost;
+                before = i;
+            }
+        }
+        mask = previous;
+        last = before;
+    }
+    tour.push_back(0);
+    reverse(tour.begin(), tour.end());
+    return tour;
+}
+
+void HeldKarpTSP::annealAll() {
+    if(n > HeldKarpTSP::maxCities) {
+        if(verbose)
+            cout << "Held-Karp takes at most " << HeldKarpTSP::maxCities << " cities, the tour is kept" << endl;
+        return;
+    }
+    if(n <= 3)  // Every tour is optimal
+        return;
+
+    const shared_ptr<const Instance>& instance = pointGraph->getInstance();
+    DistanceMetric metric = pointGraph->getDistanceMetric();
+    distances.resize(n * n);
+    for(size_t a = 0; a < n; a++)
+        for(size_t b = 0; b < n; b++)
+            distances[a * n + b] = instance->getCity(a).getDistanceTo(instance->getCity(b), metric);
+
+    // Masks of every number of cities k, in increasing order, by the next permutation of the lowest k bits
+    size_t m = n - 1;
+    uint32_t full = 1u << m;
+    masks.clear();
+    masks.reserve(full - 1);
+    layerStarts.clear();
+    for(size_t k = 1; k <= m; k++) {
+        layerStarts.push_back(masks.size());
+        for(uint32_t mask = (1u << k) - 1; mask < full;) {
+            masks.push_back(mask);
+            uint32_t lowest = mask & (~mask + 1);
+            uint32_t carried = mask + lowest;
+            mask = (((carried ^ mask) >> 2) / lowest) | carried;
+        }
+    }
+    layerStarts.push_back(masks.size());
+
+    costs.assign((size_t) full * m, numeric_limits<double>::infinity());
+    for(size_t j = 0; j < m; j++)
+        costs[((size_t) 1 << j) * m + j] = dist(0, (int) j + 1);
+
+    if(verbose)
+        cout << "---Held-Karp on " << n << " cities, " << masks.size() << " subsets---" << endl << endl;
+
+    for(size_t k = 2; k <= m; k++) {
+        size_t from = layerStarts[k - 1], to = layerStarts[k];
+        int workersNumber = (int) max<size_t>(1, min<size_t>(threadsNumber, (to - from) / minParallelLayer));
+        if(workersNumber == 1)
+            solveMasks(from, to);
+        else {
+            vector<thread> workers;
+            for(int t = 0; t < workersNumber; t++)
+                workers.emplace_back(&HeldKarpTSP::solveMasks, this, from + (to - from) * t / workersNumber,
+                                     from + (to - from) * (t + 1) / workersNumber);
+            for(auto& worker: workers)
+                worker.join();
+        }
+    }
+
+    bestState = make_shared<PointGraph>(instance, buildTour(), pointGraph->getTourRepresentation(), metric,
+                                        pointGraph->getPrecision());
+    bestE = bestState->getTotalDistance();
+    if(verbose)
+        cout << "Optimal length " << bestE << endl << endl;
+}
@@ -0,0 +1,69 @@
+#ifndef SIMULATED_ANNEALING_HELD_KARP_H
+#define SIMULATED_ANNEALING_HELD_KARP_H
+
+/**
+ * @file held_karp.h
+ *
+ * @brief Exact Held-Karp dynamic programming solver for tiny instances.
+ *
+ * Tours start at city 0 and the other m = n - 1 cities are the bits of a mask. costs holds, for every mask and
+ * every city j in it, the length of the shortest path leaving city 0, visiting the cities of the mask and ending
+ * at j. The costs of a mask are a row of m doubles, so extending the paths of a mask by one city reads a single
+ * contiguous row. Masks are processed layer by layer in order of their number of cities: the masks of a layer
+ * only read rows of the previous layer, so a large layer is split between threads. The optimal tour is read back
+ * from the costs, so no parent table is stored. Time is O(2^n n^2) and memory 2^(n-1) (n-1) doubles, 80 MB at
+ * maxCities cities.
+ *
+ * HeldKarpTSP takes the calls of SimulatedAnnealingTSP used by the drivers (annealAll(), getBestE(),
+ * getBestState(), setVerbose()), so it replaces the annealing on instances of at most maxCities cities.
+ */
+
+#include <cstdint>
+#include <vector>
+
+#include "annealing.h"
+
+
+using namespace std;
+
+
+
+class HeldKarpTSP {
+private:
+    constexpr static size_t minParallelLayer = 4096;  // Smaller layers are not split between threads
+
+    shared_ptr<PointGraph> pointGraph;  // Input graph
+    int threadsNumber;  // Number of threads sharing a layer
+    bool verbose;
+    size_t n;  // Number of cities
+    vector<double> distances;  // Distance between every two cities, n x n
+    vector<double> costs;  // Shortest path lengths, a row of n - 1 entries per mask, only entries of its cities set
+    vector<uint32_t> masks;  // Every non-empty mask, in order of the number of cities
+    vector<size_t> layerStarts;  // Position in masks of the first mask of every number of cities, and masks.size()
+    double bestE;  // Length of the optimal tour
+    shared_ptr<PointGraph> bestState;  // Optimal tour
+
+    [[nodiscard]] double dist(int a, int b) const { return distances[(size_t) a * n + (size_t) b]; }
+
+    // Fills the rows of masks[from..to)
+    void solveMasks(size_t from, size_t to);
+
+    // Reads the optimal tour back from the costs
+    [[nodiscard]] vector<int> buildTour() const;
+
+public:
+    constexpr static size_t maxCities = 20;
+
+    explicit HeldKarpTSP(const shared_ptr<PointGraph>& pointGraph, int threads=1);
+
+    // Solves the instance exactly, instances of more than maxCities cities keep their input tour
+    void annealAll();
+
+    void setVerbose(bool newVerbose) { verbose = newVerbose; }
+
+    [[nodiscard]] double getBestE() const { return bestE; }
+
+    [[nodiscard]] const shared_ptr<PointGraph>& getBestState() const { return bestState; }
+};
+
+#endif //SIMULATED_ANNEALING_HELD_KARP_H
@@ -0,0 +1,73 @@
+/**
+ * @file held_karp_test.cpp
+ *
+ * @brief Test of HeldKarpTSP against brute force.
+ *
+ * For every size from 1 to maxBruteForceCities and both metrics, random instances are solved by HeldKarpTSP and
+ * by trying every tour starting at city 0. The tour of HeldKarpTSP must visit every city once and be as short as
+ * the best tour found by brute force, and getBestE() must be its length. Returns 1 on the first mismatch.
+ */
+
+#include "held_karp.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+
+using namespace std;
+
+
+
+constexpr size_t maxBruteForceCities = 10;
+constexpr int instancesPerSize = 3;
+constexpr double tolerance = 1e-6;
+
+
+static double tourLength(const Instance& instance, const vector<int>& tour, DistanceMetric metric) {
+    double length = 0.;
+    for(size_t i = 0; i < tour.size(); i++)
+        length += instance.getCity(tour[i]).getDistanceTo(instance.getCity(tour[(i + 1) % tour.size()]), metric);
+    return length;
+}
+
+static double bruteForceLength(const Instance& instance, DistanceMetric metric) {
+    vector<int> tour = identityOrder(instance.size());
+    double best = tourLength(instance, tour, metric);
+    while(tour.size() > 1 && next_permutation(tour.begin() + 1, tour.end()))
+        best = min(best, tourLength(instance, tour, metric));
+    return best;
+}
+
+int main() {
+    mt19937 gen(2021);
+    uniform_real_distribution<double> coordinate(0., 1000.);
+    for(DistanceMetric metric: {DistanceMetric::Euclidean, DistanceMetric::Rounded})
+        for(size_t n = 1; n <= maxBruteForceCities; n++)
+            for(int i = 0; i < instancesPerSize; i++) {
+                vector<Point> cities;
+                for(size_t c = 0; c < n; c++)
+                    cities.emplace_back(coordinate(gen), coordinate(gen));
+                auto graph = make_shared<PointGraph>(cities, TourRepresentation::Array, metric);
+                HeldKarpTSP exact(graph);
+                exact.setVerbose(false);
+                exact.annealAll();
+
+                const Instance& instance = *graph->getInstance();
+                vector<int> tour = exact.getBestState()->getOrder();
+                vector<int> sorted = tour;
+                sort(sorted.begin(), sorted.end());
+                double length = tourLength(instance, tour, metric);
+                double best = bruteForceLength(instance, metric);
+                // getTotalDistance() counts the single edge of a 2-city tour once
+                double reported = n == 2 ? 2. * exact.getBestE() : exact.getBestE();
+                if(sorted != identityOrder(n) || abs(length - best) > tolerance * max(1., best)
+                   || abs(reported - length) > tolerance * max(1., length)) {
+                    cerr << "n = " << n << (metric == DistanceMetric::Rounded ? ", rounded" : "") << ": length "
+                         << length << ", reported " << exact.getBestE() << ", brute force " << best << endl;
+                    return 1;
+                }
+            }
+    cout << "HeldKarpTSP matches brute force" << endl;
+    return 0;
+}
@@ -0,0 +1,66 @@
+/**
+ * @file hilbert.cpp
+ */
+
+#include "hilbert.h"
+
+#include <algorithm>
+
+
+uint64_t hilbertIndex(uint32_t x, uint32_t y, int bits) {
+    uint32_t side = (uint32_t) 1 << bits;
+    uint64_t index = 0;
+    for(uint32_t s = side / 2; s > 0; s /= 2) {
+        uint32_t rx = (x & s) > 0 ? 1 : 0;
+        uint32_t ry = (y & s) > 0 ? 1 : 0;
+        index += (uint64_t) s * s * ((3 * rx) ^ ry);
+
+        // Rotates the quadrant, so that the sub-curve starts and ends where the curve enters and leaves it
+        if(ry == 0) {
+            if(rx == 1) {
+                x = side - 1 - x;
+                y = side - 1 - y;
+            }
+            swap(x, y);
+        }
+    }
+    return index;
+}
+
+vector<int> hilbertOrder(const vector<Point>& points) {
+    constexpr int bits = 16;
+    vector<int> order(points.size());
+    if(points.empty())
+        return order;
+
+    double minX = points[0].getX(), maxX = minX;
+    double minY = points[0].getY(), maxY = minY;
+    for(const auto& p: points) {
+        minX = min(minX, p.getX());
+        maxX = max(maxX, p.getX());
+        minY = min(minY, p.getY());
+        maxY = max(maxY, p.getY());
+    }
+
+    // One scale for both axes keeps the curve square, so neighbouring cells stay neighbours in the plane
+    double extent = max(maxX - minX, maxY - minY);
+    double scale = extent > 0. ? ((double) ((uint32_t) 1 << bits) - 1.) / extent : 0.;
+    vector<pair<uint64_t, int>> keys(points.size());
+    for(size_t i = 0; i < points.size(); i++) {
+        auto x = (uint32_t) ((points[i].getX() - minX) * scale);
+        auto y = (uint32_t) ((points[i].getY() - minY) * scale);
+        keys[i] = {hilbertIndex(x, y, bits), (int) i};
+    }
+    sort(keys.begin(), keys.end());
+    for(size_t i = 0; i < keys.size(); i++)
+        order[i] = keys[i].second;
+    return order;
+}
+
+vector<Point> permutePoints(const vector<Point>& points, const vector<int>& order) {
+    vector<Point> permuted;
+    permuted.reserve(order.size());
+    for(int i: order)
+        permuted.push_back(points[i]);
+    return permuted;
+}
@@ -0,0 +1,34 @@
+#ifndef SIMULATED_ANNEALING_HILBERT_H
+#define SIMULATED_ANNEALING_HILBERT_H
+
+/**
+ * @file hilbert.h
+ *
+ * @brief Renumbering of cities along a Hilbert curve.
+ *
+ * Cities come numbered in generation order, so cities close in the plane are scattered in memory.
+ * Sorting them by their position along a Hilbert curve over the bounding box gives nearby cities
+ * nearby numbers, so coordinates, neighbour lists and per-city flags touched by a local move share
+ * cache lines. Points keep their labels, so renumbered tours still map back to the input cities.
+ */
+
+#include <cstdint>
+#include <vector>
+
+#include "annealing.h"
+
+
+using namespace std;
+
+
+
+// Index along the Hilbert curve of order bits filling the [0, 2^bits) x [0, 2^bits) grid
+uint64_t hilbertIndex(uint32_t x, uint32_t y, int bits);
+
+// Indices of points sorted by their position along a Hilbert curve over their bounding box
+vector<int> hilbertOrder(const vector<Point>& points);
+
+// points[order[0]], points[order[1]], ...
+vector<Point> permutePoints(const vector<Point>& points, const vector<int>& order);
+
+#endif //SIMULATED_ANNEALING_HILBERT_H
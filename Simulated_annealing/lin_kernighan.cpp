@@ -0,0 +1,140 @@
+/**
+ * @file lin_kernighan.cpp
+ */
+
+#include "lin_kernighan.h"
+
+#include <algorithm>
+#include <iterator>
+
+
+// LinKernighanTSP
+
+LinKernighanTSP::LinKernighanTSP(const PointGraph& graph, double timeLimit, int neighboursNumber, int maxDepth):
+
+        maxDepth{max(1, maxDepth)},
+        timeLimit{timeLimit},
+        instance{graph.getInstance()},
+        metric{graph.getDistanceMetric()},
+        precision{graph.getPrecision()},
+        neighbours{graph.getInstance()->getNeighbourLists(neighboursNumber, graph.getDistanceMetric())},
+        tour{Tour(graph.getOrder(), graph.getTourRepresentation())},
+        queued{vector<char>(graph.size(), 0)},
+        length{0.},
+        improvingMoves{0},
+        candidates{vector<vector<pair<double, int>>>(max(1, maxDepth))}
+{
+    int n = (int) instance->size();
+    for(int i = 0; i < n; i++)
+        length += dist(i, tour.next(i));
+
+    // Smaller tours have no non-degenerate flips
+    if(n >= 5)
+        for(int i = 0; i < n; i++)
+            push(i);
+}
+
+void LinKernighanTSP::push(int city) {
+    if(!queued[city]) {
+        queued[city] = 1;
+        queue.push_back(city);
+    }
+}
+
+bool LinKernighanTSP::isAdded(int a, int b) const {
+    for(const auto& edge: addedEdges)
+        if((edge.first == a && edge.second == b) || (edge.first == b && edge.second == a))
+            return true;
+    return false;
+}
+
+bool LinKernighanTSP::step() {
+    while(!queue.empty()) {
+        int city = queue.front();
+        queue.pop_front();
+        queued[city] = 0;
+        if(improveCity(city))
+            return true;
+    }
+    return false;
+}
+
+bool LinKernighanTSP::run() {
+    auto start = chrono::steady_clock::now();
+    while(step()) {
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if(elapsed > timeLimit)
+            return queue.empty();
+    }
+    return true;
+}
+
+bool LinKernighanTSP::improveCity(int t1) {
+    for(int t2: {tour.next(t1), tour.prev(t1)}) {
+        addedEdges.clear();
+        touched.clear();
+        if(improvePath(t1, t2, dist(t1, t2), 0)) {
+            improvingMoves++;
+            push(t1);
+            for(int city: touched)
+                push(city);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool LinKernighanTSP::improvePath(int t1, int t2, double gain, int depth) {
+    // t4 lies on the same side of t3 as t1 lies of t2, which makes the step a single flip
+    bool t1IsNext = tour.next(t2) == t1;
+    vector<pair<double, int>>& levelCandidates = candidates[depth];
+    levelCandidates.clear();
+
+    const int* t2Neighbours = neighbours->of(t2);
+    for(int i = 0; i < neighbours->getK(); i++) {
+        int t3 = t2Neighbours[i];
+        double d23 = neighbours->distance(t2, i);
+        if(gain - d23 <= epsilon)
+            break;  // Lists are sorted, no further neighbour keeps the gain positive
+        if(t3 == t1 || t3 == tour.next(t2) || t3 == tour.prev(t2))
+            continue;
+        int t4 = t1IsNext ? tour.next(t3) : tour.prev(t3);
+        if(isAdded(t3, t4))
+            continue;
+        levelCandidates.emplace_back(dist(t3, t4) - d23, t3);
+    }
+    sort(levelCandidates.begin(), levelCandidates.end(), greater<>());
+
+    int tried = depth < (int) size(breadth) ? breadth[depth] : 1;
+    for(int i = 0; i < (int) levelCandidates.size() && i < tried; i++) {
+        // Undone flips may have reversed the orientation, t4 itself stays the same city
+        t1IsNext = tour.next(t2) == t1;
+        int t3 = levelCandidates[i].second;
+        int t4 = t1IsNext ? tour.next(t3) : tour.prev(t3);
+        double newGain = gain + levelCandidates[i].first;
+
+        // Removes (t2, t1), (t3, t4) and adds (t2, t3), (t1, t4)
+        tour.flip(t2, t1, t3, t4);
+        addedEdges.emplace_back(t2, t3);
+        touched.push_back(t2);
+        touched.push_back(t3);
+        touched.push_back(t4);
+
+        double closedGain = newGain - dist(t4, t1);
+        if(closedGain > epsilon) {
+            length -= closedGain;
+            return true;
+        }
+        if(depth + 1 < maxDepth && improvePath(t1, t4, newGain, depth + 1))
+            return true;
+
+        tour.flip(t2, t3, t1, t4);
+        addedEdges.pop_back();
+        touched.resize(touched.size() - 3);
+    }
+    return false;
+}
+
+PointGraph LinKernighanTSP::getGraph() const {
+    return PointGraph(instance, tour.getOrder(), tour.getRepresentation(), metric, precision);
+}
@@ -0,0 +1,88 @@
+#ifndef SIMULATED_ANNEALING_LIN_KERNIGHAN_H
+#define SIMULATED_ANNEALING_LIN_KERNIGHAN_H
+
+/**
+ * @file lin_kernighan.h
+ *
+ * @brief Lin-Kernighan style variable-depth improvement of a finished tour.
+ *
+ * A move starts by removing edge (t1, t2) and then repeatedly adds (t2, t3) and removes (t3, t4),
+ * each step being a single flip after which the tour is closed by the edge (t4, t1). The first
+ * closed tour shorter than the initial one is kept, otherwise the flips are undone. Only the first
+ * levels branch over several candidates t3, deeper levels follow the best one. Base cities are
+ * taken from a don't-look-bit queue, so the engine stops by itself at a local optimum or when its
+ * time limit runs out. It works on any tour, e.g. getBestState() of annealing replicas.
+ * Cities keep the Hilbert curve numbering of the shared Instance, so the data of nearby cities is
+ * nearby in memory, and the neighbour lists are built once per instance.
+ */
+
+#include <chrono>
+#include <deque>
+#include <vector>
+
+#include "annealing.h"
+#include "neighbours.h"
+#include "tour.h"
+
+
+using namespace std;
+
+
+
+class LinKernighanTSP {
+private:
+    constexpr static double epsilon = 1e-9;  // Smallest gain treated as an improvement
+    constexpr static int breadth[] = {5, 3};  // Number of t3 candidates tried on the first levels
+
+    const int maxDepth;  // Maximal number of flips in one move
+    const double timeLimit;  // Seconds run() may take
+    shared_ptr<const Instance> instance;  // Cities of the input graph, numbered along a Hilbert curve
+    DistanceMetric metric;  // Metric of the input graph
+    Precision precision;  // Precision of the input graph, only passed on to getGraph() (the search runs in double)
+    shared_ptr<const NeighbourLists> neighbours;  // Candidate lists restricting examined moves, shared by the instance
+    Tour tour;  // Current tour, in the representation chosen by the input graph
+    deque<int> queue;  // Cities with don't-look bit off
+    vector<char> queued;  // 1 if city is in queue
+    double length;  // Current tour length
+    long long improvingMoves;  // Number of applied moves
+
+    vector<vector<pair<double, int>>> candidates;  // Scratch candidate list (value, t3) of every level
+    vector<pair<int, int>> addedEdges;  // Edges added by the move being built
+    vector<int> touched;  // Cities whose edges the move being built changed
+
+    [[nodiscard]] double dist(int a, int b) const {
+        return instance->getCity(a).getDistanceTo(instance->getCity(b), metric);
+    }
+
+    [[nodiscard]] bool isAdded(int a, int b) const;
+
+    void push(int city);
+
+    bool improveCity(int t1);
+
+    // Extends the move whose last removed edge is (t1, t2) and whose gain so far is gain
+    bool improvePath(int t1, int t2, double gain, int depth);
+
+public:
+    constexpr static int defaultNeighboursNumber = 8;
+    constexpr static int defaultMaxDepth = 10;
+
+    explicit LinKernighanTSP(const PointGraph& graph,
+                             double timeLimit,
+                             int neighboursNumber=defaultNeighboursNumber,
+                             int maxDepth=defaultMaxDepth);
+
+    // Examines queued cities until one improving move is applied. Returns false at a local optimum.
+    bool step();
+
+    // Returns true if a local optimum was reached within the time limit.
+    bool run();
+
+    [[nodiscard]] double getLength() const { return length; }
+
+    [[nodiscard]] long long getImprovingMoves() const { return improvingMoves; }
+
+    [[nodiscard]] PointGraph getGraph() const;
+};
+
+#endif //SIMULATED_ANNEALING_LIN_KERNIGHAN_H
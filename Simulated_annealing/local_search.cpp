@@ -0,0 +1,147 @@
+/**
+ * @file local_search.cpp
+ */
+
+#include "local_search.h"
+
+
+// LocalSearchTSP
+
+LocalSearchTSP::LocalSearchTSP(const PointGraph& graph, int neighboursNumber):
+
+        instance{graph.getInstance()},
+        metric{graph.getDistanceMetric()},
+        precision{graph.getPrecision()},
+        neighbours{graph.getInstance()->getNeighbourLists(neighboursNumber, graph.getDistanceMetric())},
+        tour{Tour(graph.getOrder(), graph.getTourRepresentation())},
+        queued{vector<char>(graph.size(), 0)},
+        length{0.},
+        improvingMoves{0}
+{
+    int n = (int) instance->size();
+    for(int i = 0; i < n; i++)
+        length += dist(i, tour.next(i));
+
+    // Smaller tours have no non-degenerate 2-opt or Or-opt moves
+    if(n >= 5)
+        for(int i = 0; i < n; i++)
+            push(i);
+}
+
+void LocalSearchTSP::push(int city) {
+    if(!queued[city]) {
+        queued[city] = 1;
+        queue.push_back(city);
+    }
+}
+
+bool LocalSearchTSP::step() {
+    while(!queue.empty()) {
+        int city = queue.front();
+        queue.pop_front();
+        queued[city] = 0;
+        if(improveCity(city))
+            return true;
+    }
+    return false;
+}
+
+void LocalSearchTSP::run() {
+    while(step());
+}
+
+bool LocalSearchTSP::improveCity(int a) {
+    return tryTwoOpt(a) || tryOrOpt(a);
+}
+
+bool LocalSearchTSP::tryTwoOpt(int a) {
+    const int* candidates = neighbours->of(a);
+    for(bool forward: {true, false}) {
+        int b = succ(a, forward);
+        double dAB = dist(a, b);
+        for(int i = 0; i < neighbours->getK(); i++) {
+            int c = candidates[i];
+            double dAC = neighbours->distance(a, i);
+            if(dAC >= dAB - epsilon)
+                break;  // Lists are sorted, no further neighbour can give a positive gain
+            int d = succ(c, forward);
+            if(c == b || d == a)
+                continue;
+
+            double delta = dAC + dist(b, d) - dAB - dist(c, d);
+            if(delta < -epsilon) {
+                tour.flip(a, b, c, d);
+                length += delta;
+                improvingMoves++;
+                push(a);
+                push(b);
+                push(c);
+                push(d);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool LocalSearchTSP::tryOrOpt(int a) {
+    int n = tour.size();
+    for(bool forward: {true, false}) {
+        // Segment s1..s2 starts at a and extends in the chosen direction
+        int s1 = a, s2 = a;
+        for(int segmentLength = 1; segmentLength <= maxSegmentLength && segmentLength + 3 <= n; segmentLength++) {
+            if(segmentLength > 1)
+                s2 = succ(s2, forward);
+            int p = pred(s1, forward), nx = succ(s2, forward);
+            double removeGain = dist(p, s1) + dist(s2, nx) - dist(p, nx);
+            if(removeGain <= epsilon)
+                continue;
+
+            for(int x: {s1, s2}) {
+                const int* candidates = neighbours->of(x);
+                for(int i = 0; i < neighbours->getK(); i++) {
+                    int y = candidates[i];
+                    if(neighbours->distance(x, i) >= removeGain)
+                        break;
+                    if(tour.between(forward ? s1 : s2, y, forward ? s2 : s1))
+                        continue;
+
+                    for(bool after: {true, false}) {
+                        // Insert between c and e, where e follows c in the chosen direction
+                        int c = after ? y : pred(y, forward);
+                        int e = after ? succ(y, forward) : y;
+                        if(e == p || tour.between(forward ? s1 : s2, c, forward ? s2 : s1) ||
+                           tour.between(forward ? s1 : s2, e, forward ? s2 : s1))
+                            continue;
+
+                        double dCE = dist(c, e);
+                        double addForward = dist(c, s1) + dist(s2, e) - dCE;
+                        double addReversed = dist(c, s2) + dist(s1, e) - dCE;
+                        double delta = min(addForward, addReversed) - removeGain;
+                        if(delta >= -epsilon)
+                            continue;
+
+                        // p s1..s2 nx..c e  ->  p c..nx s2..s1 e  ->  p nx..c s2..s1 e
+                        tour.flip(p, s1, c, e);
+                        tour.flip(p, c, nx, s2);
+                        if(addForward < addReversed)
+                            tour.flip(c, s2, s1, e);  // -> p nx..c s1..s2 e
+
+                        length += delta;
+                        improvingMoves++;
+                        for(int city: {p, nx, s1, s2, c, e})
+                            push(city);
+                        return true;
+                    }
+                }
+                if(s1 == s2)
+                    break;
+            }
+        }
+    }
+    return false;
+}
+
+PointGraph LocalSearchTSP::getGraph() const {
+    return PointGraph(instance, tour.getOrder(), tour.getRepresentation(), metric, precision);
+}
@@ -0,0 +1,76 @@
+#ifndef SIMULATED_ANNEALING_LOCAL_SEARCH_H
+#define SIMULATED_ANNEALING_LOCAL_SEARCH_H
+
+/**
+ * @file local_search.h
+ *
+ * @brief 2-opt / Or-opt local optimiser driven by neighbour lists and don't-look bits.
+ *
+ * Cities waiting to be examined are kept in a queue (their don't-look bit is off). A city is
+ * dropped from the queue once no improving move starts at it, and the endpoints of every applied
+ * move are queued again. The search stops by itself when the queue is empty, i.e. at a local optimum.
+ * Cities keep the Hilbert curve numbering of the shared Instance, so the data of nearby cities is
+ * nearby in memory, and the neighbour lists are built once per instance.
+ */
+
+#include <deque>
+#include <vector>
+
+#include "annealing.h"
+#include "neighbours.h"
+#include "tour.h"
+
+
+using namespace std;
+
+
+
+class LocalSearchTSP {
+private:
+    constexpr static int maxSegmentLength = 3;  // Longest segment relocated by Or-opt
+    constexpr static double epsilon = 1e-9;  // Smallest gain treated as an improvement
+
+    shared_ptr<const Instance> instance;  // Cities of the input graph, numbered along a Hilbert curve
+    DistanceMetric metric;  // Metric of the input graph
+    Precision precision;  // Precision of the input graph, only passed on to getGraph() (the search runs in double)
+    shared_ptr<const NeighbourLists> neighbours;  // Candidate lists restricting examined moves, shared by the instance
+    Tour tour;  // Current tour, in the representation chosen by the input graph
+    deque<int> queue;  // Cities with don't-look bit off
+    vector<char> queued;  // 1 if city is in queue
+    double length;  // Current tour length
+    long long improvingMoves;  // Number of applied moves
+
+    [[nodiscard]] double dist(int a, int b) const {
+        return instance->getCity(a).getDistanceTo(instance->getCity(b), metric);
+    }
+
+    [[nodiscard]] int succ(int city, bool forward) const { return forward ? tour.next(city) : tour.prev(city); }
+
+    [[nodiscard]] int pred(int city, bool forward) const { return forward ? tour.prev(city) : tour.next(city); }
+
+    void push(int city);
+
+    bool improveCity(int a);
+
+    bool tryTwoOpt(int a);
+
+    bool tryOrOpt(int a);
+
+public:
+    constexpr static int defaultNeighboursNumber = 8;
+
+    explicit LocalSearchTSP(const PointGraph& graph, int neighboursNumber=defaultNeighboursNumber);
+
+    // Examines queued cities until one improving move is applied. Returns false at a local optimum.
+    bool step();
+
+    void run();
+
+    [[nodiscard]] double getLength() const { return length; }
+
+    [[nodiscard]] long long getImprovingMoves() const { return improvingMoves; }
+
+    [[nodiscard]] PointGraph getGraph() const;
+};
+
+#endif //SIMULATED_ANNEALING_LOCAL_SEARCH_H
@@ -0,0 +1,230 @@
+/**
+ * @file lockstep.cpp
+ */
+
+#include "lockstep.h"
+
+#include <cstring>
+
+
+// log2(u) for positive u from the bits of the float, linear between powers of 2 and so within 0.09, which is
+// all the acceptance test needs
+static inline float fastLog2(float u) {
+    int32_t bits;
+    memcpy(&bits, &u, sizeof(bits));
+    return (float) (bits - (127 << 23)) * (1.f / 8388608.f);
+}
+
+// Deltas and Metropolis tests of the moves gathered into x[slot][l], y[slot][l], with slots 0..3 = the cities
+// at lo, lo + 1, hi and hi + 1. u < exp(-delta / T) is tested as delta < -T * ln(u), which accepts every
+// improvement. Branch-free, so the loop vectorises.
+template<bool rounded>
+static void evaluateLanes(const float (&x)[4][lockstepLanes], const float (&y)[4][lockstepLanes], const float* u,
+                          const float* T, float* deltas, int32_t* accepted) {
+    auto edge = [&](int from, int to, int l) {
+        float dx = x[from][l] - x[to][l], dy = y[from][l] - y[to][l];
+        float d = sqrt(dx * dx + dy * dy);
+        return rounded ? (float) (int32_t) (d + 0.5f) : d;  // Truncation rounds the non-negative d
+    };
+    for(int l = 0; l < lockstepLanes; l++) {
+        deltas[l] = edge(0, 2, l) + edge(1, 3, l) - edge(0, 1, l) - edge(2, 3, l);
+        accepted[l] = (int32_t) (deltas[l] < -0.69314718f * T[l] * fastLog2(u[l]));
+    }
+}
+
+
+// LockstepKernel
+
+template<size_t N>
+LockstepKernel<N>::LockstepKernel(DistanceMetric metric):
+
+        metric{metric},
+        x{},
+        y{},
+        tour{},
+        bestTour{},
+        n{},
+        rngState{},
+        T0{},
+        length{},
+        bestLength{},
+        exactLengths{}
+{
+    random_device rd;
+    for(auto& state: rngState)
+        state = rd() | 1u;
+}
+
+template<size_t N>
+void LockstepKernel<N>::load(int lane, const vector<Point>& cities) {
+    size_t size = cities.size();
+    double minX = cities[0].getX(), maxX = minX;
+    double minY = cities[0].getY(), maxY = minY;
+    for(const auto& p: cities) {
+        minX = min(minX, p.getX());
+        maxX = max(maxX, p.getX());
+        minY = min(minY, p.getY());
+        maxY = max(maxY, p.getY());
+    }
+    double area = (maxX - minX) * (maxY - minY);
+    double edgeLength = area > 0. ? 0.7124 * sqrt(area / (double) size) : 1.;
+
+    double centreX = (minX + maxX) / 2., centreY = (minY + maxY) / 2.;
+    for(size_t c = 0; c < size; c++) {
+        x[lane][c] = (float) (cities[c].getX() - centreX);
+        y[lane][c] = (float) (cities[c].getY() - centreY);
+        tour[lane][c] = (uint8_t) c;
+    }
+    tour[lane][size] = tour[lane][0];
+    n[lane] = (uint32_t) size;
+    T0[lane] = (float) (LockstepKernel<N>::initialT * edgeLength);
+
+    length[lane] = 0.;
+    for(size_t c = 0; c < size; c++) {
+        float dx = x[lane][tour[lane][c]] - x[lane][tour[lane][c + 1]];
+        float dy = y[lane][tour[lane][c]] - y[lane][tour[lane][c + 1]];
+        float d = sqrt(dx * dx + dy * dy);
+        length[lane] += metric == DistanceMetric::Rounded ? floor(d + 0.5f) : d;
+    }
+    bestLength[lane] = length[lane];
+    memcpy(bestTour[lane].data(), tour[lane].data(), N);
+}
+
+template<size_t N>
+void LockstepKernel<N>::run(const vector<const vector<Point>*>& instances, int iterationsPerCity) {
+    int instancesNumber = min((int) instances.size(), lanes);
+    if(instancesNumber == 0)
+        return;
+    size_t largest = 0;
+    for(int lane = 0; lane < lanes; lane++) {
+        const vector<Point>& cities = *instances[lane < instancesNumber ? lane : 0];
+        load(lane, cities);
+        largest = max(largest, cities.size());
+    }
+
+    const long long iterations = (long long) iterationsPerCity * (long long) largest;
+    // Slots 0..3 are the cities at lo, lo + 1, hi and hi + 1 of the reversal of [lo + 1, hi]
+    alignas(64) float gx[4][lanes], gy[4][lanes];
+    alignas(64) uint32_t lo[lanes], hi[lanes];
+    alignas(64) float u[lanes], T[lanes], delta[lanes];
+    alignas(64) int32_t accepted[lanes];
+
+    for(long long k = 0; k < iterations; k++) {
+        float cooling = 1.f - (float) k / (float) iterations;
+        cooling *= cooling;  // PowerFast schedule
+
+        // Xorshift draws of the moves, branch-free
+        for(int l = 0; l < lanes; l++) {
+            uint32_t s = rngState[l];
+            s ^= s << 13; s ^= s >> 17; s ^= s << 5;
+            uint32_t p = (uint32_t) (((uint64_t) s * n[l]) >> 32);
+            s ^= s << 13; s ^= s >> 17; s ^= s << 5;
+            uint32_t q = p + 1 + (uint32_t) (((uint64_t) s * (n[l] - 1)) >> 32);
+            q = q >= n[l] ? q - n[l] : q;
+            s ^= s << 13; s ^= s >> 17; s ^= s << 5;
+            u[l] = (float) ((s >> 8) + 1) * (1.f / 16777216.f);  // In (0, 1]
+            rngState[l] = s;
+            lo[l] = min(p, q);
+            hi[l] = max(p, q);
+            T[l] = T0[l] * cooling;
+        }
+
+        // Position n holds the first city again, so hi + 1 needs no wrap around
+        for(int l = 0; l < lanes; l++) {
+            int cities[4] = {tour[l][lo[l]], tour[l][lo[l] + 1], tour[l][hi[l]], tour[l][hi[l] + 1]};
+            for(int slot = 0; slot < 4; slot++) {
+                gx[slot][l] = x[l][cities[slot]];
+                gy[slot][l] = y[l][cities[slot]];
+            }
+        }
+
+        if(metric == DistanceMetric::Rounded)
+            evaluateLanes<true>(gx, gy, u, T, delta, accepted);
+        else
+            evaluateLanes<false>(gx, gy, u, T, delta, accepted);
+
+        for(int l = 0; l < lanes; l++) {
+            if(!accepted[l])
+                continue;
+            reverse(tour[l].begin() + lo[l] + 1, tour[l].begin() + hi[l] + 1);
+            length[l] += delta[l];
+            if(length[l] < bestLength[l]) {
+                bestLength[l] = length[l];
+                memcpy(bestTour[l].data(), tour[l].data(), N);  // Fixed length, compiled to a few moves
+            }
+        }
+    }
+
+    for(int lane = 0; lane < instancesNumber; lane++) {
+        const vector<Point>& cities = *instances[lane];
+        exactLengths[lane] = 0.;
+        for(size_t c = 0; c < n[lane]; c++) {
+            size_t next = c + 1 == n[lane] ? 0 : c + 1;
+            exactLengths[lane] += cities[bestTour[lane][c]].getDistanceTo(cities[bestTour[lane][next]], metric);
+        }
+    }
+}
+
+template<size_t N>
+vector<int> LockstepKernel<N>::getTour(int lane) const {
+    return vector<int>(bestTour[lane].begin(), bestTour[lane].begin() + n[lane]);
+}
+
+template class LockstepKernel<8>;
+template class LockstepKernel<16>;
+template class LockstepKernel<32>;
+template class LockstepKernel<64>;
+template class LockstepKernel<128>;
+
+
+// LockstepAnnealingTSP
+
+LockstepAnnealingTSP::LockstepAnnealingTSP(DistanceMetric metric):
+
+        kernel8{metric},
+        kernel16{metric},
+        kernel32{metric},
+        kernel64{metric},
+        kernel128{metric},
+        capacity{lockstepCapacities[0]}
+{}
+
+void LockstepAnnealingTSP::run(const vector<const vector<Point>*>& instances, int iterationsPerCity) {
+    size_t largest = 0;
+    for(size_t lane = 0; lane < instances.size() && lane < (size_t) lanes; lane++)
+        largest = max(largest, instances[lane]->size());
+    capacity = LockstepAnnealingTSP::maxCities;
+    for(size_t kernelCapacity: lockstepCapacities)
+        if(largest <= kernelCapacity) {
+            capacity = kernelCapacity;
+            break;
+        }
+
+    switch(capacity) {
+        case 8: kernel8.run(instances, iterationsPerCity); break;
+        case 16: kernel16.run(instances, iterationsPerCity); break;
+        case 32: kernel32.run(instances, iterationsPerCity); break;
+        case 64: kernel64.run(instances, iterationsPerCity); break;
+        default: kernel128.run(instances, iterationsPerCity); break;
+    }
+}
+
+vector<int> LockstepAnnealingTSP::getTour(int lane) const {
+    switch(capacity) {
+        case 8: return kernel8.getTour(lane);
+        case 16: return kernel16.getTour(lane);
+        case 32: return kernel32.getTour(lane);
+        case 64: return kernel64.getTour(lane);
+        default: return kernel128.getTour(lane);
+    }
+}
+
+double LockstepAnnealingTSP::getLength(int lane) const {
+    switch(capacity) {
+        case 8: return kernel8.getLength(lane);
+        case 16: return kernel16.getLength(lane);
+        case 32: return kernel32.getLength(lane);
+        case 64: return kernel64.getLength(lane);
+        default: return kernel128.getLength(lane);
+    }
+}
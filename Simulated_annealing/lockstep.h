@@ -0,0 +1,100 @@
+#ifndef SIMULATED_ANNEALING_LOCKSTEP_H
+#define SIMULATED_ANNEALING_LOCKSTEP_H
+
+/**
+ * @file lockstep.h
+ *
+ * @brief Lockstep annealing of several small instances, one per lane.
+ *
+ * On instances of a few dozen cities SimulatedAnnealingTSP spends most of an iteration on its bookkeeping
+ * rather than on the distances. LockstepKernel<N> anneals up to lanes instances of at most N cities together
+ * with 2-opt moves: every iteration draws one move per lane, and the random numbers, the deltas and the
+ * Metropolis tests of all lanes are computed by branch-free loops over the lanes, which the compiler
+ * vectorises. Only the gathers of the move endpoints and the reversals of accepted moves work lane by lane.
+ * Tours and coordinates live in std::arrays sized at compile time, so a kernel kept between batches does not
+ * allocate and copies of a tour have a fixed length. The reversals never move position 0, so every tour ends
+ * with a copy of its first city and the move endpoints are gathered without wrapping around. Coordinates are
+ * floats recentred on every instance, lengths are tracked in double and the reported lengths are recomputed
+ * from the input points.
+ *
+ * LockstepAnnealingTSP holds a kernel of every capacity in lockstepCapacities and runs every batch on the
+ * smallest one holding its largest instance.
+ */
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "annealing.h"
+
+
+using namespace std;
+
+
+
+constexpr int lockstepLanes = 8;  // Number of instances annealed together
+constexpr size_t lockstepCapacities[] = {8, 16, 32, 64, 128};  // Capacities of the kernels
+
+
+template<size_t N>
+class LockstepKernel {
+public:
+    constexpr static int lanes = lockstepLanes;
+
+private:
+    constexpr static double initialT = 1.;  // Initial temperature, in expected optimal edge lengths
+
+    DistanceMetric metric;  // Metric of every instance
+
+    // Instance and state of every lane, lanes without an instance repeat lane 0
+    alignas(64) array<array<float, N>, lanes> x;  // City coordinates, recentred
+    alignas(64) array<array<float, N>, lanes> y;
+    alignas(64) array<array<uint8_t, N + 1>, lanes> tour;  // Input positions of the cities in tour order
+    alignas(64) array<array<uint8_t, N>, lanes> bestTour;
+    alignas(64) array<uint32_t, lanes> n;  // Number of cities
+    alignas(64) array<uint32_t, lanes> rngState;  // Xorshift states
+    alignas(64) array<float, lanes> T0;  // Initial temperature
+    array<double, lanes> length;  // Length of tour
+    array<double, lanes> bestLength;  // Length of bestTour
+    array<double, lanes> exactLengths;  // Lengths of the best tours recomputed from the input points
+
+    void load(int lane, const vector<Point>& cities);
+
+public:
+    explicit LockstepKernel(DistanceMetric metric=DistanceMetric::Euclidean);
+
+    // Anneals 1 to lanes instances of 5 to N cities, for iterationsPerCity times the size of the largest
+    void run(const vector<const vector<Point>*>& instances, int iterationsPerCity);
+
+    // Best tour of the instance of lane, as input positions
+    [[nodiscard]] vector<int> getTour(int lane) const;
+
+    [[nodiscard]] double getLength(int lane) const { return exactLengths[lane]; }
+};
+
+
+class LockstepAnnealingTSP {
+public:
+    constexpr static int lanes = lockstepLanes;
+    constexpr static size_t maxCities = 128;  // Largest instance a lane takes
+
+private:
+    LockstepKernel<8> kernel8;
+    LockstepKernel<16> kernel16;
+    LockstepKernel<32> kernel32;
+    LockstepKernel<64> kernel64;
+    LockstepKernel<128> kernel128;
+    size_t capacity;  // Capacity of the kernel of the last run
+
+public:
+    explicit LockstepAnnealingTSP(DistanceMetric metric=DistanceMetric::Euclidean);
+
+    // Anneals 1 to lanes instances of 5 to maxCities cities on the smallest kernel holding the largest of them
+    void run(const vector<const vector<Point>*>& instances, int iterationsPerCity);
+
+    [[nodiscard]] vector<int> getTour(int lane) const;
+
+    [[nodiscard]] double getLength(int lane) const;
+};
+
+#endif //SIMULATED_ANNEALING_LOCKSTEP_H
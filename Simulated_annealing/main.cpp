@@ -8,6 +8,10 @@
 
 #include "application.h"
 #include "annealing.h"
+#include "batch.h"
+
+#include <fstream>
+#include <string>
 
 using namespace std;
 
@@ -15,7 +19,54 @@ int WINDOW_WIDTH = 720;
 int WINDOW_HEIGHT = 720;
 int PADDING = 20;
 
-int main() {
+// Solves the instances of a manifest without the window (see batch.h), reading standard input for "-"
+int runBatch(int argc, char* argv[]) {
+    string manifestPath = argv[2];
+    int threads = (int) thread::hardware_concurrency();
+    int iterationsPerCity = BatchRunner::defaultIterationsPerCity;
+    DistanceMetric metric = DistanceMetric::Euclidean;
+    bool lockstep = true;
+    size_t exactCities = BatchRunner::defaultExactCities;
+    for(int i = 3; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if(arg == "--threads" && hasValue)
+            threads = stoi(argv[++i]);
+        else if(arg == "--iterations-per-city" && hasValue)
+            iterationsPerCity = stoi(argv[++i]);
+        else if(arg == "--metric" && hasValue)
+            metric = string(argv[++i]) == "rounded" ? DistanceMetric::Rounded : DistanceMetric::Euclidean;
+        else if(arg == "--no-lockstep")
+            lockstep = false;
+        else if(arg == "--exact-cities" && hasValue)
+            exactCities = stoul(argv[++i]);
+    }
+
+    ifstream manifest;
+    if(manifestPath != "-") {
+        manifest.open(manifestPath);
+        if(!manifest) {
+            cerr << "Cannot open " << manifestPath << endl;
+            return 1;
+        }
+    }
+
+    BatchRunner runner(threads, iterationsPerCity, metric, lockstep, exactCities);
+    cout.precision(10);
+    auto start = chrono::steady_clock::now();
+    size_t instances = runner.run(manifestPath == "-" ? cin : manifest, cout);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cerr << instances << " instances in " << seconds << " s, " << (double) instances / seconds << " instances/s"
+         << endl;
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+
+    // Usage: Simulated_annealing --batch MANIFEST|- [--threads P] [--iterations-per-city K] [--metric rounded]
+    //                                                [--no-lockstep] [--exact-cities K]
+    if(argc > 2 && string(argv[1]) == "--batch")
+        return runBatch(argc, argv);
 
     // Initialize annealing object with random PointGraph
     auto randGenX = RandomDoubleGenerator(PADDING, WINDOW_WIDTH - PADDING, 0., 0.);
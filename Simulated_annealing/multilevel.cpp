@@ -0,0 +1,132 @@
+/**
+ * @file multilevel.cpp
+ */
+
+#include "multilevel.h"
+#include "domain_decomposition.h"
+#include "local_search.h"
+
+
+// MultilevelTSP
+
+MultilevelTSP::MultilevelTSP(const PointGraph& graph, int threads, size_t coarsestSize):
+
+        instance{graph.getInstance()},
+        metric{graph.getDistanceMetric()},
+        representation{graph.getTourRepresentation()},
+        precision{graph.getPrecision()},
+        threads{max(1, threads)},
+        coarseLevels{vector<vector<Point>>()},
+        tour{graph.getOrder()},
+        length{0.}
+{
+    while(getLevelCities(coarseLevels.size()).size() > max<size_t>(coarsestSize, 3))
+        coarseLevels.push_back(coarsen(getLevelCities(coarseLevels.size())));
+}
+
+vector<Point> MultilevelTSP::coarsen(const vector<Point>& cities) {
+    vector<Point> merged;
+    merged.reserve((cities.size() + 1) / 2);
+    for(size_t i = 0; i < cities.size(); i += 2) {
+        if(i + 1 == cities.size())
+            merged.emplace_back(cities[i].getX(), cities[i].getY());
+        else
+            merged.emplace_back((cities[i].getX() + cities[i + 1].getX()) / 2.,
+                                (cities[i].getY() + cities[i + 1].getY()) / 2.);
+    }
+    return merged;
+}
+
+vector<int> MultilevelTSP::project(const vector<int>& coarseTour, size_t level) const {
+    const vector<Point>& coarse = getLevelCities(level);
+    const vector<Point>& fine = getLevelCities(level - 1);
+    vector<int> fineTour;
+    fineTour.reserve(fine.size());
+    for(size_t k = 0; k < coarseTour.size(); k++) {
+        int a = 2 * coarseTour[k], b = a + 1;
+        if(b == (int) fine.size()) {
+            fineTour.push_back(a);
+            continue;
+        }
+
+        // The pair is entered from the last projected city and left towards the next merged city
+        const Point& next = coarse[coarseTour[k + 1 == coarseTour.size() ? 0 : k + 1]];
+        double straight = fine[b].getDistanceTo(next), swapped = fine[a].getDistanceTo(next);
+        if(!fineTour.empty()) {
+            straight += fine[fineTour.back()].getDistanceTo(fine[a]);
+            swapped += fine[fineTour.back()].getDistanceTo(fine[b]);
+        }
+        if(swapped < straight)
+            swap(a, b);
+        fineTour.push_back(a);
+        fineTour.push_back(b);
+    }
+    return fineTour;
+}
+
+vector<int> MultilevelTSP::refine(const vector<int>& levelTour, size_t level, long long moves) const {
+    // Coarse levels get instances of their own, which number their cities anew
+    shared_ptr<const Instance> levelInstance = level == 0 ? instance : make_shared<const Instance>(getLevelCities(level));
+    vector<int> order = levelTour;
+    if(level > 0)
+        for(int& city: order)
+            city = levelInstance->getInputNumbers()[city];
+
+    DomainAnnealingTSP domains(PointGraph(levelInstance, order, representation, metric, precision), threads);
+    double T0 = MultilevelTSP::refinementT * levelInstance->getEdgeLength();
+    for(int epoch = 0; epoch < MultilevelTSP::refinementEpochs; epoch++) {
+        double T = T0 * (double) (MultilevelTSP::refinementEpochs - epoch - 1) / MultilevelTSP::refinementEpochs;
+        domains.runEpoch(T, moves / MultilevelTSP::refinementEpochs, MultilevelTSP::refinementRange);
+    }
+
+    order = domains.getBestGraph().getOrder();
+    if(level > 0) {
+        vector<int> levelNumbers = inverseOrder(levelInstance->getInputNumbers());
+        for(int& city: order)
+            city = levelNumbers[city];
+    }
+    return order;
+}
+
+void MultilevelTSP::run(int iterations) {
+    size_t coarsestLevel = coarseLevels.size();
+    int coarseIterations = max(1, iterations / 2);
+    size_t refinedCities = 0;
+    for(size_t level = 0; level < coarsestLevel; level++)
+        refinedCities += getLevelCities(level).size();
+
+    // The coarsest level starts from its curve order, or from the input tour if it is the input itself
+    shared_ptr<PointGraph> coarsest = coarsestLevel == 0 ?
+            make_shared<PointGraph>(instance, tour, representation, metric, precision) :
+            make_shared<PointGraph>(getLevelCities(coarsestLevel), representation, metric, precision);
+    SimulatedAnnealingTSP annealing(coarsest,
+                                    coarseIterations,
+                                    max(1, coarseIterations / 5),
+                                    max(1, coarseIterations / 10),
+                                    Temperature::PowerFast,
+                                    NextState::OrOpt);
+    annealing.setVerbose(false);
+    annealing.annealAll();
+    vector<int> levelTour = annealing.getBestState()->getOrder();
+    if(coarsestLevel > 0) {
+        vector<int> levelNumbers = inverseOrder(annealing.getBestState()->getInstance()->getInputNumbers());
+        for(int& city: levelTour)
+            city = levelNumbers[city];
+    }
+
+    for(size_t level = coarsestLevel; level > 0; level--) {
+        levelTour = project(levelTour, level);
+        long long moves = (long long) (iterations - coarseIterations) * (long long) getLevelCities(level - 1).size()
+                          / (long long) max<size_t>(1, refinedCities);
+        levelTour = refine(levelTour, level - 1, moves);
+    }
+
+    LocalSearchTSP localSearch(PointGraph(instance, levelTour, representation, metric, precision));
+    localSearch.run();
+    tour = localSearch.getGraph().getOrder();
+    length = localSearch.getLength();
+}
+
+PointGraph MultilevelTSP::getGraph() const {
+    return PointGraph(instance, tour, representation, metric, precision);
+}
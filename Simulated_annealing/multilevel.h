@@ -0,0 +1,71 @@
+#ifndef SIMULATED_ANNEALING_MULTILEVEL_H
+#define SIMULATED_ANNEALING_MULTILEVEL_H
+
+/**
+ * @file multilevel.h
+ *
+ * @brief Multilevel coarsen-solve-refine pipeline for very large instances.
+ *
+ * Cities are numbered along a Hilbert curve, so cities 2i and 2i + 1 are a matched pair of close cities.
+ * Every coarsening merges such pairs into their centroid, halving the instance, until it has at most
+ * coarsestSize cities. The coarsest instance is annealed from scratch by SimulatedAnnealingTSP. Its tour
+ * is then projected level by level: every merged city is replaced by its two cities, in the orientation
+ * joining its neighbours in the tour best, and the projected tour is refined by a short cold annealing
+ * of DomainAnnealingTSP, whose regions run in parallel. A local search polishes the finest tour.
+ * Global structure is thus settled on small instances, and the full resolution only fixes local detail.
+ */
+
+#include <vector>
+
+#include "annealing.h"
+
+
+using namespace std;
+
+
+
+class MultilevelTSP {
+private:
+    constexpr static double refinementT = 0.3;  // Initial refinement temperature, in expected optimal edge lengths
+    constexpr static size_t refinementRange = 64;  // Move range of the refinement
+    constexpr static int refinementEpochs = 8;  // Number of temperature steps of every refinement
+
+    shared_ptr<const Instance> instance;  // Cities of the input graph (level 0)
+    DistanceMetric metric;  // Metric of the input graph
+    TourRepresentation representation;  // Passed on to getGraph()
+    Precision precision;  // Passed on to getGraph()
+    int threads;  // Number of regions refined in parallel
+    vector<vector<Point>> coarseLevels;  // Level l + 1, its city i merges cities 2i and 2i + 1 of level l
+    vector<int> tour;  // Tour through the input cities, by city number
+    double length;  // Length of tour
+
+    [[nodiscard]] const vector<Point>& getLevelCities(size_t level) const {
+        return level == 0 ? instance->getCities() : coarseLevels[level - 1];
+    }
+
+    // Centroids of the consecutive pairs of cities
+    static vector<Point> coarsen(const vector<Point>& cities);
+
+    // Tour through the cities of level - 1 visiting the pairs merged by level in the order of coarseTour
+    [[nodiscard]] vector<int> project(const vector<int>& coarseTour, size_t level) const;
+
+    // Anneals the tour through the cities of level with the refinement schedule, returns the best tour found
+    [[nodiscard]] vector<int> refine(const vector<int>& levelTour, size_t level, long long moves) const;
+
+public:
+    constexpr static size_t defaultCoarsestSize = 1000;
+
+    explicit MultilevelTSP(const PointGraph& graph, int threads=1, size_t coarsestSize=defaultCoarsestSize);
+
+    // Spends half of the iterations on the coarsest instance and the rest on the refinements, in
+    // proportion to the size of their levels
+    void run(int iterations);
+
+    [[nodiscard]] size_t getLevelsNumber() const { return coarseLevels.size() + 1; }
+
+    [[nodiscard]] double getLength() const { return length; }
+
+    [[nodiscard]] PointGraph getGraph() const;
+};
+
+#endif //SIMULATED_ANNEALING_MULTILEVEL_H
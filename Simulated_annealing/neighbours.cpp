@@ -0,0 +1,105 @@
+/**
+ * @file neighbours.cpp
+ */
+
+#include "neighbours.h"
+
+#include <algorithm>
+#include <queue>
+
+
+// NeighbourLists
+
+NeighbourLists::NeighbourLists(const vector<Point>& cities, int neighboursNumber, DistanceMetric metric):
+
+        metric{metric}
+{
+    int n = (int) cities.size();
+    k = max(0, min(neighboursNumber, n - 1));
+    neighbours = vector<int>((size_t) n * k);
+    if(metric == DistanceMetric::Rounded)
+        roundedDistances = vector<int32_t>((size_t) n * k);
+    else
+        distances = vector<double>((size_t) n * k);
+    if(k == 0)
+        return;
+
+    double minX = cities[0].getX(), maxX = minX;
+    double minY = cities[0].getY(), maxY = minY;
+    for(const auto& p: cities) {
+        minX = min(minX, p.getX());
+        maxX = max(maxX, p.getX());
+        minY = min(minY, p.getY());
+        maxY = max(maxY, p.getY());
+    }
+
+    // Roughly two cities per cell
+    int gridSize = max(1, (int) sqrt((double) n / 2.));
+    double cellW = max((maxX - minX) / gridSize, 1e-12);
+    double cellH = max((maxY - minY) / gridSize, 1e-12);
+    double cellMin = min(cellW, cellH);
+
+    auto cellX = [&](const Point& p) { return min(gridSize - 1, (int) ((p.getX() - minX) / cellW)); };
+    auto cellY = [&](const Point& p) { return min(gridSize - 1, (int) ((p.getY() - minY) / cellH)); };
+
+    // Counting sort of cities into cells
+    vector<int> cellStart((size_t) gridSize * gridSize + 1, 0);
+    vector<int> cellItems(n);
+    for(const auto& p: cities)
+        cellStart[cellY(p) * gridSize + cellX(p) + 1]++;
+    for(size_t c = 1; c < cellStart.size(); c++)
+        cellStart[c] += cellStart[c - 1];
+    vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+    for(int i = 0; i < n; i++)
+        cellItems[fill[cellY(cities[i]) * gridSize + cellX(cities[i])]++] = i;
+
+    // Max-heap of (squared distance, city) holding the k best candidates found so far
+    priority_queue<pair<double, int>> best;
+
+    for(int i = 0; i < n; i++) {
+        const Point& p = cities[i];
+        int cx = cellX(p), cy = cellY(p);
+
+        for(int r = 0; r < gridSize; r++) {
+            for(int y = cy - r; y <= cy + r; y++) {
+                if(y < 0 || y >= gridSize)
+                    continue;
+                // Inner rows of the ring contribute only their two border cells
+                int step = (y == cy - r || y == cy + r) ? 1 : max(1, 2 * r);
+                for(int x = cx - r; x <= cx + r; x += step) {
+                    if(x < 0 || x >= gridSize)
+                        continue;
+                    int cell = y * gridSize + x;
+                    for(int c = cellStart[cell]; c < cellStart[cell + 1]; c++) {
+                        int j = cellItems[c];
+                        if(j == i)
+                            continue;
+                        double dx = p.getX() - cities[j].getX();
+                        double dy = p.getY() - cities[j].getY();
+                        double d2 = dx * dx + dy * dy;
+                        if((int) best.size() < k)
+                            best.emplace(d2, j);
+                        else if(d2 < best.top().first) {
+                            best.pop();
+                            best.emplace(d2, j);
+                        }
+                    }
+                }
+            }
+            // Every city outside the rings searched so far is at least r * cellMin away
+            if((int) best.size() == k && best.top().first <= (r * cellMin) * (r * cellMin))
+                break;
+        }
+
+        for(int slot = k - 1; slot >= 0; slot--) {
+            size_t at = (size_t) i * k + slot;
+            int j = best.top().second;
+            neighbours[at] = j;
+            if(metric == DistanceMetric::Rounded)
+                roundedDistances[at] = p.getRoundedDistanceTo(cities[j]);
+            else
+                distances[at] = sqrt(best.top().first);
+            best.pop();
+        }
+    }
+}
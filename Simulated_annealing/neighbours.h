@@ -0,0 +1,46 @@
+#ifndef SIMULATED_ANNEALING_NEIGHBOURS_H
+#define SIMULATED_ANNEALING_NEIGHBOURS_H
+
+/**
+ * @file neighbours.h
+ *
+ * @brief Candidate neighbour lists (k nearest cities of every city) used to restrict
+ * the moves examined by the local optimisers.
+ */
+
+#include <vector>
+
+#include "annealing.h"
+
+
+using namespace std;
+
+
+
+class NeighbourLists {
+private:
+    int k;  // Number of neighbours kept for every city
+    DistanceMetric metric;  // Metric of the stored distances
+    vector<int> neighbours;  // k nearest cities of city c, closest first, at [c * k, (c + 1) * k)
+    vector<double> distances;  // Distances to the neighbours, same layout (Euclidean metric only)
+    vector<int32_t> roundedDistances;  // Distances to the neighbours, same layout (Rounded metric only)
+
+public:
+    NeighbourLists(): k{0}, metric{DistanceMetric::Euclidean} {}
+
+    // Builds the lists with a uniform grid, so the cost is close to O(n k) for spread out points.
+    // Rounding keeps the distances sorted, so the lists are the same for both metrics.
+    NeighbourLists(const vector<Point>& cities, int neighboursNumber, DistanceMetric metric=DistanceMetric::Euclidean);
+
+    [[nodiscard]] int getK() const { return k; }
+
+    [[nodiscard]] const int* of(int city) const { return neighbours.data() + (size_t) city * k; }
+
+    // Distance from city to its slot-th neighbour
+    [[nodiscard]] double distance(int city, int slot) const {
+        size_t i = (size_t) city * k + slot;
+        return metric == DistanceMetric::Rounded ? (double) roundedDistances[i] : distances[i];
+    }
+};
+
+#endif //SIMULATED_ANNEALING_NEIGHBOURS_H
@@ -0,0 +1,238 @@
+/**
+ * @file rejection_free.cpp
+ */
+
+#include "rejection_free.h"
+
+
+// SumTree
+
+SumTree::SumTree(size_t size):
+
+        leaves{1},
+        tree{vector<double>()}
+{
+    while(leaves < size)
+        leaves *= 2;
+    tree = vector<double>(2 * leaves, 0.);
+}
+
+void SumTree::refresh(size_t first, size_t last) {
+    // Sums are recomputed from the children rather than adjusted by differences, so they never drift
+    first += leaves;
+    last += leaves;
+    while(first > 1) {
+        first /= 2;
+        last /= 2;
+        for(size_t node = first; node <= last; node++)
+            tree[node] = tree[2 * node] + tree[2 * node + 1];
+    }
+}
+
+void SumTree::rebuild() {
+    for(size_t node = leaves - 1; node >= 1; node--)
+        tree[node] = tree[2 * node] + tree[2 * node + 1];
+}
+
+size_t SumTree::find(double target) const {
+    size_t node = 1;
+    while(node < leaves) {
+        if(target < tree[2 * node] || tree[2 * node + 1] == 0.)
+            node = 2 * node;
+        else {
+            target -= tree[2 * node];
+            node = 2 * node + 1;
+        }
+    }
+    return node - leaves;
+}
+
+
+// RejectionFreeTSP
+
+RejectionFreeTSP::RejectionFreeTSP(const PointGraph& graph, double T, int neighboursNumber):
+
+        instance{graph.getInstance()},
+        metric{graph.getDistanceMetric()},
+        representation{graph.getTourRepresentation()},
+        precision{graph.getPrecision()},
+        neighbours{graph.getInstance()->getNeighbourLists(neighboursNumber, graph.getDistanceMetric())},
+        reverseStart{vector<int>(graph.size() + 1, 0)},
+        reverseMoves{vector<int>()},
+        next{vector<int>(graph.size())},
+        prev{vector<int>(graph.size())},
+        nextLength{vector<double>(graph.size())},
+        removal{vector<double>(graph.size())},
+        weights{SumTree()},
+        T{T},
+        length{CompensatedSum()},
+        bestLength{0.},
+        sinceBest{vector<pair<int, int>>()},
+        bestOrder{vector<int>()},
+        bestMaterialised{false},
+        acceptedMoves{0}
+{
+    int n = (int) instance->size();
+    int k = neighbours->getK();
+    const vector<int>& order = graph.getOrder();
+    for(int i = 0; i < n; i++) {
+        next[order[i]] = order[i == n - 1 ? 0 : i + 1];
+        prev[order[i]] = order[i == 0 ? n - 1 : i - 1];
+    }
+    for(int i = 0; i < n; i++) {
+        updateEdges(i);
+        length.add(nextLength[i]);
+    }
+    bestLength = length.value();
+
+    // Counting sort of the (city, slot) entries by neighbour
+    for(int c = 0; c < n; c++)
+        for(int slot = 0; slot < k; slot++)
+            reverseStart[neighbours->of(c)[slot] + 1]++;
+    for(int j = 0; j < n; j++)
+        reverseStart[j + 1] += reverseStart[j];
+    reverseMoves = vector<int>((size_t) n * k);
+    vector<int> fill(reverseStart.begin(), reverseStart.end() - 1);
+    for(int c = 0; c < n; c++)
+        for(int slot = 0; slot < k; slot++)
+            reverseMoves[fill[neighbours->of(c)[slot]]++] = c * k + slot;
+
+    weights = SumTree(movesNumber());
+    setTemperature(T);
+}
+
+bool RejectionFreeTSP::decodeMove(size_t m, int& city, int& a, int& b) const {
+    int k = neighbours->getK();
+    city = (int) (m / (2 * k));
+    int j = neighbours->of(city)[(m / 2) % k];
+    a = m % 2 == 0 ? j : prev[j];
+    b = m % 2 == 0 ? next[j] : j;
+    return a != city && b != city;
+}
+
+void RejectionFreeTSP::updateEdges(int city) {
+    nextLength[city] = dist(city, next[city]);
+    int p = prev[city];
+    removal[city] = dist(p, next[city]) - dist(p, city) - nextLength[city];
+}
+
+double RejectionFreeTSP::getDelta(size_t m, int city, int a, int b) const {
+    // The distance to the neighbour itself is stored in the list
+    double toNeighbour = neighbours->distance(city, (int) ((m / 2) % neighbours->getK()));
+    double added = m % 2 == 0 ? toNeighbour + dist(city, b) : dist(a, city) + toNeighbour;
+    return removal[city] + added - nextLength[a];
+}
+
+double RejectionFreeTSP::getWeight(size_t m) const {
+    int city, a, b;
+    if(!decodeMove(m, city, a, b))
+        return 0.;
+    double delta = getDelta(m, city, a, b);
+    if(T <= 0.)
+        return delta < -epsilon ? 1. : 0.;
+    if(delta < 0.)
+        return 1.;
+    return delta > 50. * T ? 0. : exp(-delta / T);
+}
+
+void RejectionFreeTSP::setTemperature(double newT) {
+    T = newT;
+    for(size_t m = 0; m < movesNumber(); m++)
+        weights.assign(m, getWeight(m));
+    weights.rebuild();
+}
+
+void RejectionFreeTSP::updateWeights(int city, bool nextChanged, bool prevChanged) {
+    size_t k = neighbours->getK();
+    size_t first = (size_t) city * 2 * k;
+    for(size_t m = first; m < first + 2 * k; m++)
+        weights.assign(m, getWeight(m));
+    weights.refresh(first, first + 2 * k - 1);
+
+    for(int r = reverseStart[city]; r < reverseStart[city + 1]; r++) {
+        size_t m = 2 * (size_t) reverseMoves[r];
+        if(nextChanged)
+            weights.set(m, getWeight(m));
+        if(prevChanged)
+            weights.set(m + 1, getWeight(m + 1));
+    }
+}
+
+void RejectionFreeTSP::applyRandomMove(double u) {
+    size_t m = weights.find(u * weights.total());
+    int city, a, b;
+    if(weights.get(m) == 0. || !decodeMove(m, city, a, b))
+        return;
+
+    double delta = getDelta(m, city, a, b);
+    int p = prev[city], nx = next[city];
+    if(!bestMaterialised) {
+        sinceBest.emplace_back(city, p);
+        if(sinceBest.size() > instance->size()) {
+            bestOrder = getBestOrder();
+            bestMaterialised = true;
+            sinceBest.clear();
+        }
+    }
+
+    next[p] = nx;
+    prev[nx] = p;
+    next[a] = city;
+    prev[city] = a;
+    next[city] = b;
+    prev[b] = city;
+    length.add(delta);
+    acceptedMoves++;
+
+    if(length.value() < bestLength) {
+        bestLength = length.value();
+        sinceBest.clear();
+        bestMaterialised = false;
+    }
+
+    // Successors of p, a and city changed, predecessors of nx, b and city
+    for(int changed: {p, nx, city, a, b})
+        updateEdges(changed);
+    updateWeights(city, true, true);
+    updateWeights(p, true, false);
+    updateWeights(a, true, false);
+    updateWeights(nx, false, true);
+    updateWeights(b, false, true);
+}
+
+vector<int> RejectionFreeTSP::getOrder(const vector<int>& successors) const {
+    vector<int> order;
+    order.reserve(instance->size());
+    int city = 0;
+    do {
+        order.push_back(city);
+        city = successors[city];
+    } while(city != 0);
+    return order;
+}
+
+vector<int> RejectionFreeTSP::getBestOrder() const {
+    if(bestMaterialised)
+        return bestOrder;
+    vector<int> successors = next, predecessors = prev;
+    for(auto it = sinceBest.rbegin(); it != sinceBest.rend(); it++) {
+        // Moving the city back after its old predecessor restores the tour from before the move
+        int city = it->first, p = it->second;
+        successors[predecessors[city]] = successors[city];
+        predecessors[successors[city]] = predecessors[city];
+        int q = successors[p];
+        successors[p] = city;
+        predecessors[city] = p;
+        successors[city] = q;
+        predecessors[q] = city;
+    }
+    return getOrder(successors);
+}
+
+PointGraph RejectionFreeTSP::getGraph() const {
+    return PointGraph(instance, getOrder(next), representation, metric, precision);
+}
+
+PointGraph RejectionFreeTSP::getBestGraph() const {
+    return PointGraph(instance, getBestOrder(), representation, metric, precision);
+}
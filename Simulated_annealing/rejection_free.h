@@ -0,0 +1,134 @@
+#ifndef SIMULATED_ANNEALING_REJECTION_FREE_H
+#define SIMULATED_ANNEALING_REJECTION_FREE_H
+
+/**
+ * @file rejection_free.h
+ *
+ * @brief Rejection-free (n-fold way) annealing for the low temperature phase.
+ *
+ * The moves are insertions of a city next to one of its nearest neighbours, on a doubly linked tour.
+ * Every move carries its Metropolis acceptance probability as a weight in a sum tree, so an accepted
+ * move is sampled directly instead of proposing and rejecting candidates. With M moves and total
+ * weight W the Metropolis chain with uniform proposals accepts with probability p = W / M per
+ * iteration, so the number of iterations skipped by one accepted move is geometric with mean 1 / p.
+ * After a move only the weights of moves touching the five cities whose tour neighbours changed
+ * are recomputed, each from cached edge lengths and a single new distance. The best tour is kept as
+ * the list of moves made since it was reached, and materialised only when that list grows longer
+ * than the tour. Cities keep the Hilbert curve numbering of the shared Instance, so the weights,
+ * edges and neighbour lists of nearby cities are nearby in memory.
+ */
+
+#include <vector>
+
+#include "annealing.h"
+#include "neighbours.h"
+
+
+using namespace std;
+
+
+
+// Complete binary tree of partial sums over non-negative weights
+class SumTree {
+private:
+    size_t leaves;  // Number of leaves, a power of two
+    vector<double> tree;  // Node i has children 2i and 2i + 1, leaf j is node leaves + j
+
+public:
+    explicit SumTree(size_t size=0);
+
+    void set(size_t index, double weight) { assign(index, weight); refresh(index, index); }
+
+    // Changes a leaf without its ancestors, which have to be recomputed by refresh() or rebuild()
+    void assign(size_t index, double weight) { tree[leaves + index] = weight; }
+
+    // Recomputes the ancestors of the leaves [first, last]
+    void refresh(size_t first, size_t last);
+
+    // Recomputes all inner nodes
+    void rebuild();
+
+    [[nodiscard]] double get(size_t index) const { return tree[leaves + index]; }
+
+    [[nodiscard]] double total() const { return tree[1]; }
+
+    // Index of the leaf whose prefix interval contains target (0 <= target < total())
+    [[nodiscard]] size_t find(double target) const;
+};
+
+
+class RejectionFreeTSP {
+private:
+    constexpr static double epsilon = 1e-9;  // Smallest gain treated as an improvement at T = 0
+
+    shared_ptr<const Instance> instance;  // Cities of the input graph, numbered along a Hilbert curve
+    DistanceMetric metric;  // Metric of the input graph
+    TourRepresentation representation;  // Passed on to getGraph()
+    Precision precision;  // Passed on to getGraph()
+    shared_ptr<const NeighbourLists> neighbours;  // Target cities of the insertion moves, shared by the instance
+    vector<int> reverseStart;  // Moves inserting next to city j are reverseMoves[reverseStart[j], reverseStart[j + 1])
+    vector<int> reverseMoves;  // Entries c * k + slot of cities c having j as their slot-th neighbour
+    vector<int> next;  // Successor of every city in the tour
+    vector<int> prev;  // Predecessor of every city in the tour
+    vector<double> nextLength;  // Length of the edge from every city to its successor
+    vector<double> removal;  // Change of tour length caused by removing every city from the tour
+    SumTree weights;  // Acceptance probability of every move at temperature T
+    double T;  // Temperature of the weights
+    CompensatedSum length;  // Current tour length
+    double bestLength;  // Lowest tour length so far
+    vector<pair<int, int>> sinceBest;  // (city, its predecessor before the move) of the moves made since the best tour
+    vector<int> bestOrder;  // Tour of bestLength once sinceBest grew too long to be kept
+    bool bestMaterialised;  // Whether bestOrder is valid, in which case sinceBest is not kept
+    long long acceptedMoves;  // Number of applied moves
+
+    [[nodiscard]] double dist(int a, int b) const {
+        return instance->getCity(a).getDistanceTo(instance->getCity(b), metric);
+    }
+
+    [[nodiscard]] size_t movesNumber() const { return instance->size() * neighbours->getK() * 2; }
+
+    // Move m inserts city m / 2k after (m even) or before (m odd) its (m / 2 mod k)-th neighbour,
+    // i.e. between a and b. Returns false for moves leaving the tour unchanged.
+    bool decodeMove(size_t m, int& city, int& a, int& b) const;
+
+    [[nodiscard]] double getDelta(size_t m, int city, int a, int b) const;
+
+    [[nodiscard]] double getWeight(size_t m) const;
+
+    void updateEdges(int city);
+
+    // Recomputes the weights of the moves of city, and of the moves inserting other cities after it
+    // (if its successor changed) or before it (if its predecessor changed)
+    void updateWeights(int city, bool nextChanged, bool prevChanged);
+
+    [[nodiscard]] vector<int> getOrder(const vector<int>& successors) const;
+
+    // Undoes the moves of sinceBest on a copy of the tour
+    [[nodiscard]] vector<int> getBestOrder() const;
+
+public:
+    constexpr static int defaultNeighboursNumber = 8;
+
+    explicit RejectionFreeTSP(const PointGraph& graph, double T, int neighboursNumber=defaultNeighboursNumber);
+
+    // Recomputes every weight, O(M)
+    void setTemperature(double newT);
+
+    // Probability that a Metropolis iteration with a uniformly drawn move of this set is accepted
+    [[nodiscard]] double getAcceptanceRate() const { return weights.total() / (double) movesNumber(); }
+
+    // Applies a move drawn with probability proportional to its weight, u is uniform in [0, 1)
+    void applyRandomMove(double u);
+
+    [[nodiscard]] double getLength() const { return length.value(); }
+
+    [[nodiscard]] double getBestLength() const { return bestLength; }
+
+    [[nodiscard]] long long getAcceptedMoves() const { return acceptedMoves; }
+
+    [[nodiscard]] PointGraph getGraph() const;
+
+    [[nodiscard]] PointGraph getBestGraph() const;
+};
+
+#endif //SIMULATED_ANNEALING_REJECTION_FREE_H
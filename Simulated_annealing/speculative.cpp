@@ -0,0 +1,188 @@
+/**
+ * @file speculative.cpp
+ */
+
+#include "speculative.h"
+
+#include <algorithm>
+
+
+// SpeculativeAnnealingTSP
+
+SpeculativeAnnealingTSP::SpeculativeAnnealingTSP(const PointGraph& graph, int threads):
+
+        instance{graph.getInstance()},
+        metric{graph.getDistanceMetric()},
+        representation{graph.getTourRepresentation()},
+        precision{graph.getPrecision()},
+        threadsNumber{max(1, threads)},
+        order{graph.getOrder()},
+        tags{vector<atomic<int>>(graph.size() / SpeculativeAnnealingTSP::blockSize + 1)},
+        generators{vector<mt19937>()},
+        threadDeltas{vector<double>(threadsNumber, 0.)},
+        threadAccepted{vector<long long>(threadsNumber, 0)},
+        threadClaims{vector<long long>(threadsNumber, 0)},
+        threadConflicts{vector<long long>(threadsNumber, 0)},
+        length{CompensatedSum()},
+        bestLength{0.},
+        bestOrder{vector<int>()},
+        acceptedMoves{0},
+        claims{0},
+        conflicts{0},
+        epochs{0}
+{
+    random_device rd;
+    for(int t = 0; t < threadsNumber; t++)
+        generators.emplace_back(rd());
+
+    size_t n = order.size();
+    for(size_t i = 0; n > 1 && i < n; i++)
+        length.add(dist(order[i], order[i + 1 == n ? 0 : i + 1]));
+    bestLength = length.value();
+    bestOrder = order;
+}
+
+bool SpeculativeAnnealingTSP::claim(size_t from, size_t to, int owner) {
+    size_t first = from / SpeculativeAnnealingTSP::blockSize, last = to / SpeculativeAnnealingTSP::blockSize;
+    for(size_t block = first; block <= last; block++) {
+        int expected = 0;
+        if(!tags[block].compare_exchange_strong(expected, owner, memory_order_acquire)) {
+            for(size_t taken = first; taken < block; taken++)
+                tags[taken].store(0, memory_order_release);
+            return false;
+        }
+    }
+    return true;
+}
+
+void SpeculativeAnnealingTSP::release(size_t from, size_t to) {
+    // Releasing publishes the changes of the window to the thread claiming it next
+    for(size_t block = from / SpeculativeAnnealingTSP::blockSize; block <= to / SpeculativeAnnealingTSP::blockSize;
+        block++)
+        tags[block].store(0, memory_order_release);
+}
+
+void SpeculativeAnnealingTSP::runThread(int thread, double T, long long moves, size_t range) {
+    size_t n = order.size();
+    mt19937& gen = generators[thread];
+    uniform_real_distribution<double> uniform(0., 1.);
+    auto draw = [&gen](size_t count) { return uniform_int_distribution<size_t>(0, count - 1)(gen); };
+
+    // Positions 1 .. n - 2 move, the tour ends are fixed until the rotation after the epoch
+    size_t inner = n - 2;
+    size_t reach = range == 0 ? max<size_t>(1, n / (4 * threadsNumber)) : range;
+    reach = min(reach, inner);
+    CompensatedSum delta;
+    long long accepted = 0, attempts = 0, failed = 0;
+    for(long long move = 0; move < moves; move++) {
+        bool twoOpt = (gen() & 1) != 0;
+        size_t i, last, after = 0;
+        bool reversed = false;
+        if(twoOpt) {
+            // Reversal of [i, last]
+            i = 1 + draw(inner - 1);
+            last = i + 1 + draw(min(reach, n - 2 - i));
+        }
+        else {
+            // Relocation of [i, last] between after and after + 1
+            size_t segmentLength = 1 + draw(SpeculativeAnnealingTSP::maxSegmentLength);
+            i = 1 + draw(n - 1 - segmentLength);
+            last = i + segmentLength - 1;
+            size_t from = i - 1 > reach ? i - 1 - reach : 0;
+            size_t to = min(n - 2, last + reach);
+            after = from + draw(to - from + 1);
+            if(after + 1 >= i && after <= last)
+                continue;
+            reversed = (gen() & 1) != 0;
+        }
+
+        size_t windowFrom = twoOpt ? i - 1 : min(i - 1, after);
+        size_t windowTo = twoOpt ? last + 1 : max(last + 1, after + 1);
+        attempts++;
+        while(!claim(windowFrom, windowTo, thread + 1)) {
+            failed++;
+            attempts++;
+            this_thread::yield();
+        }
+
+        double change;
+        if(twoOpt)
+            change = dist(order[i - 1], order[last]) + dist(order[i], order[last + 1])
+                     - dist(order[i - 1], order[i]) - dist(order[last], order[last + 1]);
+        else {
+            int p = order[i - 1], q = order[last + 1], x = order[after], y = order[after + 1];
+            int toX = reversed ? order[last] : order[i], toY = reversed ? order[i] : order[last];
+            change = dist(p, q) + dist(x, toX) + dist(toY, y) - dist(p, order[i]) - dist(order[last], q) - dist(x, y);
+        }
+
+        if(change < 0. || (T > 0. && uniform(gen) < exp(-change / T))) {
+            if(twoOpt)
+                reverse(order.begin() + (long) i, order.begin() + (long) last + 1);
+            else {
+                size_t segmentLength = last - i + 1;
+                size_t newFirst;
+                if(after > last) {
+                    rotate(order.begin() + (long) i, order.begin() + (long) last + 1,
+                           order.begin() + (long) after + 1);
+                    newFirst = after + 1 - segmentLength;
+                }
+                else {
+                    rotate(order.begin() + (long) after + 1, order.begin() + (long) i,
+                           order.begin() + (long) last + 1);
+                    newFirst = after + 1;
+                }
+                if(reversed)
+                    reverse(order.begin() + (long) newFirst, order.begin() + (long) (newFirst + segmentLength));
+            }
+            delta.add(change);
+            accepted++;
+        }
+        release(windowFrom, windowTo);
+    }
+
+    threadDeltas[thread] = delta.value();
+    threadAccepted[thread] = accepted;
+    threadClaims[thread] = attempts;
+    threadConflicts[thread] = failed;
+}
+
+void SpeculativeAnnealingTSP::runEpoch(double T, long long moves, size_t range) {
+    size_t n = order.size();
+    if(n < SpeculativeAnnealingTSP::minTourLength)
+        return;
+
+    if(threadsNumber == 1)
+        runThread(0, T, moves, range);
+    else {
+        vector<thread> workers;
+        for(int t = 0; t < threadsNumber; t++)
+            workers.emplace_back([this, t, T, moves, range]() {
+                runThread(t, T, moves * (t + 1) / threadsNumber - moves * t / threadsNumber, range);
+            });
+        for(auto& worker: workers)
+            worker.join();
+    }
+
+    for(int t = 0; t < threadsNumber; t++) {
+        length.add(threadDeltas[t]);
+        acceptedMoves += threadAccepted[t];
+        claims += threadClaims[t];
+        conflicts += threadConflicts[t];
+    }
+    if(length.value() < bestLength) {
+        bestLength = length.value();
+        bestOrder = order;
+    }
+
+    // A random rotation moves the fixed tour ends, so the edge closing the tour is optimised as well
+    rotate(order.begin(), order.begin() + (long) (1 + generators[0]() % (n - 1)), order.end());
+    epochs++;
+}
+
+PointGraph SpeculativeAnnealingTSP::getGraph() const {
+    return PointGraph(instance, order, representation, metric, precision);
+}
+
+PointGraph SpeculativeAnnealingTSP::getBestGraph() const {
+    return PointGraph(instance, bestOrder, representation, metric, precision);
+}
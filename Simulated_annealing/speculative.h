@@ -0,0 +1,92 @@
+#ifndef SIMULATED_ANNEALING_SPECULATIVE_H
+#define SIMULATED_ANNEALING_SPECULATIVE_H
+
+/**
+ * @file speculative.h
+ *
+ * @brief Parallel annealing with speculative moves on one shared tour.
+ *
+ * All threads draw 2-opt and Or-opt moves anywhere on the same tour. Before evaluating a move a thread
+ * claims the tour positions it reads and writes, with one atomic ownership tag per block of positions.
+ * A claim takes every tag of its window or none of them, so two moves commit concurrently only when
+ * their windows are disjoint; a conflicting claim is released and retried. The share of failed claims
+ * is the conflict rate. Tour ends stay fixed during an epoch and the tour is rotated between epochs, so
+ * windows never wrap around. Acceptance is Metropolis at the temperature of the epoch.
+ */
+
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "annealing.h"
+
+
+using namespace std;
+
+
+
+class SpeculativeAnnealingTSP {
+private:
+    constexpr static size_t blockSize = 16;  // Number of positions guarded by one ownership tag
+    constexpr static size_t minTourLength = 8;  // Shorter tours are not annealed
+    constexpr static int maxSegmentLength = 3;  // Longest segment relocated by Or-opt
+
+    shared_ptr<const Instance> instance;  // Cities of the input graph
+    DistanceMetric metric;  // Metric of the input graph
+    TourRepresentation representation;  // Passed on to getGraph()
+    Precision precision;  // Passed on to getGraph() (the moves are evaluated in double)
+    int threadsNumber;  // Number of threads making moves
+    vector<int> order;  // City at every tour position, shared by all threads
+    vector<atomic<int>> tags;  // Owner (thread + 1) of every block of positions, 0 if unclaimed
+    vector<mt19937> generators;  // Random engine of every thread
+    vector<double> threadDeltas;  // Change of length caused by every thread in the last epoch
+    vector<long long> threadAccepted;  // Moves accepted by every thread in the last epoch
+    vector<long long> threadClaims;  // Claims attempted by every thread in the last epoch
+    vector<long long> threadConflicts;  // Claims of every thread that failed in the last epoch
+    CompensatedSum length;  // Current tour length
+    double bestLength;  // Lowest tour length seen at the end of an epoch
+    vector<int> bestOrder;  // Tour of bestLength
+    long long acceptedMoves;  // Number of applied moves
+    long long claims;  // Number of claims attempted
+    long long conflicts;  // Number of claims that failed
+    long long epochs;  // Number of epochs run
+
+    [[nodiscard]] double dist(int a, int b) const {
+        return instance->getCity(a).getDistanceTo(instance->getCity(b), metric);
+    }
+
+    // Takes the tags of the positions [from, to] for owner, or none of them if one is taken already
+    bool claim(size_t from, size_t to, int owner);
+
+    void release(size_t from, size_t to);
+
+    // Makes moves moves reaching at most range positions, claiming every one of them
+    void runThread(int thread, double T, long long moves, size_t range);
+
+public:
+    SpeculativeAnnealingTSP(const PointGraph& graph, int threads);
+
+    // Runs moves Metropolis iterations at temperature T split evenly between the threads. Moves reach
+    // at most range positions, or n / (4 * threads) for range 0. The tour is rotated afterwards.
+    void runEpoch(double T, long long moves, size_t range=0);
+
+    [[nodiscard]] int getThreadsNumber() const { return threadsNumber; }
+
+    [[nodiscard]] double getLength() const { return length.value(); }
+
+    [[nodiscard]] double getBestLength() const { return bestLength; }
+
+    [[nodiscard]] long long getAcceptedMoves() const { return acceptedMoves; }
+
+    [[nodiscard]] long long getEpochs() const { return epochs; }
+
+    // Share of the claims that conflicted with another thread
+    [[nodiscard]] double getConflictRate() const { return claims == 0 ? 0. : (double) conflicts / (double) claims; }
+
+    [[nodiscard]] PointGraph getGraph() const;
+
+    [[nodiscard]] PointGraph getBestGraph() const;
+};
+
+#endif //SIMULATED_ANNEALING_SPECULATIVE_H
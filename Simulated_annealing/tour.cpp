@@ -0,0 +1,226 @@
+/**
+ * @file tour.cpp
+ */
+
+#include "tour.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <utility>
+
+
+vector<int> identityOrder(size_t n) {
+    vector<int> order(n);
+    iota(order.begin(), order.end(), 0);
+    return order;
+}
+
+vector<int> inverseOrder(const vector<int>& order) {
+    vector<int> inverse(order.size());
+    for(size_t i = 0; i < order.size(); i++)
+        inverse[order[i]] = (int) i;
+    return inverse;
+}
+
+
+// ArrayTour
+
+ArrayTour::ArrayTour(const vector<int>& initialOrder):
+
+        n{(int) initialOrder.size()},
+        order{initialOrder},
+        position{vector<int>(initialOrder.size())}
+{
+    for(int i = 0; i < n; i++)
+        position[order[i]] = i;
+}
+
+bool ArrayTour::between(int a, int b, int c) const {
+    int pa = position[a], pb = position[b], pc = position[c];
+    if(pa <= pc)
+        return pa <= pb && pb <= pc;
+    return pb >= pa || pb <= pc;
+}
+
+void ArrayTour::flip(int a, int b, int c, int d) {
+    if(next(a) != b) {
+        swap(a, b);
+        swap(c, d);
+    }
+
+    // Reverse the path b..c, or the complementary path d..a when that one is shorter
+    int from = position[b], to = position[c];
+    int length = to - from;
+    if(length < 0)
+        length += n;
+    length++;
+    if(2 * length > n) {
+        from = position[d];
+        to = position[a];
+        length = n - length;
+    }
+    reversePath(from, to, length);
+}
+
+void ArrayTour::reversePath(int from, int to, int length) {
+    for(int s = 0; s < length / 2; s++) {
+        int cityA = order[from], cityB = order[to];
+        order[from] = cityB;
+        position[cityB] = from;
+        order[to] = cityA;
+        position[cityA] = to;
+        from = from == n - 1 ? 0 : from + 1;
+        to = to == 0 ? n - 1 : to - 1;
+    }
+}
+
+
+// TwoLevelListTour
+
+TwoLevelListTour::TwoLevelListTour(const vector<int>& initialOrder):
+
+        n{(int) initialOrder.size()},
+        blockSize{max(1, (int) sqrt((double) initialOrder.size()))},
+        maxBlocks{0},
+        blocks{vector<Block>()},
+        blockOrder{vector<int>()},
+        cityBlock{vector<int>(initialOrder.size())},
+        cityIndex{vector<int>(initialOrder.size())}
+{
+    rebuild(initialOrder);
+}
+
+void TwoLevelListTour::rebuild(const vector<int>& order) {
+    blocks.clear();
+    blockOrder.clear();
+    for(int from = 0; from < n; from += blockSize) {
+        int to = min(n, from + blockSize);
+        int id = (int) blocks.size();
+        blocks.push_back(Block{vector<int>(order.begin() + from, order.begin() + to), false, id, from});
+        blockOrder.push_back(id);
+        for(int i = from; i < to; i++) {
+            cityBlock[order[i]] = id;
+            cityIndex[order[i]] = i - from;
+        }
+    }
+    maxBlocks = 2 * (int) blocks.size() + 2;
+}
+
+void TwoLevelListTour::renumberBlocks() {
+    int start = 0;
+    for(int r = 0; r < (int) blockOrder.size(); r++) {
+        Block& block = blocks[blockOrder[r]];
+        block.rank = r;
+        block.start = start;
+        start += (int) block.cities.size();
+    }
+}
+
+int TwoLevelListTour::next(int city) const {
+    const Block& block = blocks[cityBlock[city]];
+    int i = cityIndex[city];
+    if(!block.reversed) {
+        if(i + 1 < (int) block.cities.size())
+            return block.cities[i + 1];
+    }
+    else if(i > 0)
+        return block.cities[i - 1];
+    int r = block.rank + 1;
+    return firstOf(r == (int) blockOrder.size() ? 0 : r);
+}
+
+int TwoLevelListTour::prev(int city) const {
+    const Block& block = blocks[cityBlock[city]];
+    int i = cityIndex[city];
+    if(!block.reversed) {
+        if(i > 0)
+            return block.cities[i - 1];
+    }
+    else if(i + 1 < (int) block.cities.size())
+        return block.cities[i + 1];
+    int r = block.rank;
+    return lastOf(r == 0 ? (int) blockOrder.size() - 1 : r - 1);
+}
+
+bool TwoLevelListTour::between(int a, int b, int c) const {
+    int pa = position(a), pb = position(b), pc = position(c);
+    if(pa <= pc)
+        return pa <= pb && pb <= pc;
+    return pb >= pa || pb <= pc;
+}
+
+void TwoLevelListTour::splitBefore(int city) {
+    if(offset(city) == 0)
+        return;
+
+    // The cities behind index j of the block form the new block, placed after the block in tour
+    // order, or before it when the block is reversed
+    int id = cityBlock[city];
+    int j = blocks[id].reversed ? cityIndex[city] + 1 : cityIndex[city];
+    vector<int>& cities = blocks[id].cities;
+    Block tail{vector<int>(cities.begin() + j, cities.end()), blocks[id].reversed, 0, 0};
+    cities.resize(j);
+
+    int tailId = (int) blocks.size();
+    for(int i = 0; i < (int) tail.cities.size(); i++) {
+        cityBlock[tail.cities[i]] = tailId;
+        cityIndex[tail.cities[i]] = i;
+    }
+    int rank = blocks[id].rank;
+    blockOrder.insert(blockOrder.begin() + (tail.reversed ? rank : rank + 1), tailId);
+    blocks.push_back(move(tail));
+    renumberBlocks();
+}
+
+void TwoLevelListTour::flip(int a, int b, int c, int d) {
+    if(next(a) != b) {
+        swap(a, b);
+        swap(c, d);
+    }
+
+    // Reverse the path b..c, or the complementary path d..a when that one is shorter
+    int from = b, to = c;
+    int length = position(c) - position(b);
+    if(length < 0)
+        length += n;
+    length++;
+    if(2 * length > n) {
+        from = d;
+        to = a;
+    }
+
+    if((int) blockOrder.size() + 2 > maxBlocks)
+        rebuild(getOrder());
+
+    // Make the path consist of whole blocks
+    splitBefore(from);
+    splitBefore(next(to));
+
+    int m = (int) blockOrder.size();
+    int r1 = blocks[cityBlock[from]].rank, r2 = blocks[cityBlock[to]].rank;
+    int count = r2 - r1;
+    if(count < 0)
+        count += m;
+    count++;
+    for(int s = 0; s < count / 2; s++)
+        swap(blockOrder[(r1 + s) % m], blockOrder[(r2 - s + m) % m]);
+    for(int s = 0; s < count; s++) {
+        Block& block = blocks[blockOrder[(r1 + s) % m]];
+        block.reversed = !block.reversed;
+    }
+    renumberBlocks();
+}
+
+vector<int> TwoLevelListTour::getOrder() const {
+    vector<int> order;
+    order.reserve(n);
+    for(int id: blockOrder) {
+        const Block& block = blocks[id];
+        if(block.reversed)
+            order.insert(order.end(), block.cities.rbegin(), block.cities.rend());
+        else
+            order.insert(order.end(), block.cities.begin(), block.cities.end());
+    }
+    return order;
+}
@@ -0,0 +1,174 @@
+#ifndef SIMULATED_ANNEALING_TOUR_H
+#define SIMULATED_ANNEALING_TOUR_H
+
+/**
+ * @file tour.h
+ *
+ * @brief Tour representations operating on city indices, used by the local optimisers.
+ *
+ * Every representation offers next / prev / between queries and a flip performing a 2-opt move.
+ * A flip may reverse either side of the tour, so callers must not rely on the tour orientation
+ * being preserved between flips.
+ */
+
+#include <vector>
+
+
+using namespace std;
+
+
+
+enum class TourRepresentation { Array, TwoLevelList };
+
+
+vector<int> identityOrder(size_t n);
+
+// inverse[order[i]] = i
+vector<int> inverseOrder(const vector<int>& order);
+
+
+
+// Flip costs O(n) as the shorter side of the array is reversed.
+class ArrayTour {
+private:
+    int n;  // Number of cities
+    vector<int> order;  // Cities in tour order
+    vector<int> position;  // Index of every city in order
+
+    void reversePath(int from, int to, int length);
+
+public:
+    explicit ArrayTour(const vector<int>& initialOrder);
+
+    [[nodiscard]] int size() const { return n; }
+
+    [[nodiscard]] int next(int city) const {
+        int p = position[city] + 1;
+        return order[p == n ? 0 : p];
+    }
+
+    [[nodiscard]] int prev(int city) const {
+        int p = position[city];
+        return order[p == 0 ? n - 1 : p - 1];
+    }
+
+    // True if b lies on the forward path from a to c (inclusive)
+    [[nodiscard]] bool between(int a, int b, int c) const;
+
+    // 2-opt move: removes edges (a, b), (c, d) and adds (a, c), (b, d).
+    // Requires b == next(a) and d == next(c), or b == prev(a) and d == prev(c).
+    void flip(int a, int b, int c, int d);
+
+    [[nodiscard]] vector<int> getOrder() const { return order; }
+};
+
+
+
+// Tour cut into about sqrt(n) blocks, each with a reversal bit. A flip splits at most two blocks
+// and reverses the order of the blocks in between, so it costs O(sqrt n); the blocks are rebuilt
+// once splitting has doubled their number.
+class TwoLevelListTour {
+private:
+    struct Block {
+        vector<int> cities;  // Cities of the block, in tour order unless reversed
+        bool reversed;  // Whether the block is traversed from its last city to its first one
+        int rank;  // Index of the block in blockOrder
+        int start;  // Tour position of the first city of the block
+    };
+
+    int n;  // Number of cities
+    int blockSize;  // Size of blocks after a rebuild
+    int maxBlocks;  // Number of blocks triggering a rebuild
+    vector<Block> blocks;
+    vector<int> blockOrder;  // Blocks in tour order
+    vector<int> cityBlock;  // Block holding every city
+    vector<int> cityIndex;  // Index of every city in the cities vector of its block
+
+    void rebuild(const vector<int>& order);
+
+    void renumberBlocks();
+
+    [[nodiscard]] int offset(int city) const {
+        const Block& block = blocks[cityBlock[city]];
+        return block.reversed ? (int) block.cities.size() - 1 - cityIndex[city] : cityIndex[city];
+    }
+
+    [[nodiscard]] int firstOf(int blockRank) const {
+        const Block& block = blocks[blockOrder[blockRank]];
+        return block.reversed ? block.cities.back() : block.cities.front();
+    }
+
+    [[nodiscard]] int lastOf(int blockRank) const {
+        const Block& block = blocks[blockOrder[blockRank]];
+        return block.reversed ? block.cities.front() : block.cities.back();
+    }
+
+    // Splits the block of city so that city becomes the first city of a block
+    void splitBefore(int city);
+
+public:
+    explicit TwoLevelListTour(const vector<int>& initialOrder);
+
+    [[nodiscard]] int size() const { return n; }
+
+    [[nodiscard]] int position(int city) const { return blocks[cityBlock[city]].start + offset(city); }
+
+    [[nodiscard]] int next(int city) const;
+
+    [[nodiscard]] int prev(int city) const;
+
+    [[nodiscard]] bool between(int a, int b, int c) const;
+
+    void flip(int a, int b, int c, int d);
+
+    [[nodiscard]] vector<int> getOrder() const;
+};
+
+
+
+// Tour whose representation is chosen at construction time
+class Tour {
+private:
+    TourRepresentation representation;
+    ArrayTour arrayTour;
+    TwoLevelListTour listTour;
+
+public:
+    Tour(const vector<int>& initialOrder, TourRepresentation representation):
+
+            representation{representation},
+            arrayTour{ArrayTour(representation == TourRepresentation::Array ? initialOrder : vector<int>())},
+            listTour{TwoLevelListTour(representation == TourRepresentation::TwoLevelList ? initialOrder : vector<int>())}
+    {}
+
+    [[nodiscard]] TourRepresentation getRepresentation() const { return representation; }
+
+    [[nodiscard]] int size() const {
+        return representation == TourRepresentation::Array ? arrayTour.size() : listTour.size();
+    }
+
+    [[nodiscard]] int next(int city) const {
+        return representation == TourRepresentation::Array ? arrayTour.next(city) : listTour.next(city);
+    }
+
+    [[nodiscard]] int prev(int city) const {
+        return representation == TourRepresentation::Array ? arrayTour.prev(city) : listTour.prev(city);
+    }
+
+    [[nodiscard]] bool between(int a, int b, int c) const {
+        return representation == TourRepresentation::Array ? arrayTour.between(a, b, c) : listTour.between(a, b, c);
+    }
+
+    void flip(int a, int b, int c, int d) {
+        if(representation == TourRepresentation::Array)
+            arrayTour.flip(a, b, c, d);
+        else
+            listTour.flip(a, b, c, d);
+    }
+
+    [[nodiscard]] vector<int> getOrder() const {
+        return representation == TourRepresentation::Array ? arrayTour.getOrder() : listTour.getOrder();
+    }
+};
+
+#endif //SIMULATED_ANNEALING_TOUR_H
@@ -0,0 +1,91 @@
+/**
+ * @file tour_test.cpp
+ *
+ * @brief Differential test of TwoLevelListTour against ArrayTour.
+ *
+ * Both tours start from the same shuffled order and take the same random flips, in both directions and with
+ * paths wrapping around the tour end, many more than needed for the list to rebuild its blocks. A flip may
+ * reverse either side of the tour, so after every flip the tours must agree up to orientation on next, prev
+ * and between. Returns 1 on the first mismatch.
+ */
+
+#include "tour.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+
+using namespace std;
+
+
+
+// Compares every next and prev, and between on every triple of small tours or on random triples of large ones
+static bool sameTour(const ArrayTour& array, const TwoLevelListTour& list, mt19937& gen) {
+    int n = array.size();
+    if(list.size() != n)
+        return false;
+    bool forward = n < 3 || list.next(0) == array.next(0);
+    for(int city = 0; city < n; city++) {
+        int next = forward ? array.next(city) : array.prev(city);
+        int prev = forward ? array.prev(city) : array.next(city);
+        if(list.next(city) != next || list.prev(city) != prev)
+            return false;
+    }
+
+    auto sameBetween = [&](int a, int b, int c) {
+        return list.between(a, b, c) == (forward ? array.between(a, b, c) : array.between(c, b, a));
+    };
+    if(n <= 16) {
+        for(int a = 0; a < n; a++)
+            for(int b = 0; b < n; b++)
+                for(int c = 0; c < n; c++)
+                    if(!sameBetween(a, b, c))
+                        return false;
+        return true;
+    }
+    uniform_int_distribution<int> city(0, n - 1);
+    for(int i = 0; i < 256; i++)
+        if(!sameBetween(city(gen), city(gen), city(gen)))
+            return false;
+    return true;
+}
+
+static bool testSize(int n, int flips, mt19937& gen) {
+    vector<int> order = identityOrder(n);
+    shuffle(order.begin(), order.end(), gen);
+    ArrayTour array(order);
+    TwoLevelListTour list(order);
+    if(!sameTour(array, list, gen)) {
+        cerr << "n = " << n << ": tours differ after construction" << endl;
+        return false;
+    }
+
+    uniform_int_distribution<int> city(0, n - 1);
+    for(int f = 0; f < flips; f++) {
+        // Every third flip removes the edge closing the array, so the reversed path wraps around its end
+        int a = f % 3 == 0 ? array.getOrder().back() : city(gen), c = city(gen);
+        bool forward = gen() % 2 == 0;
+        int b = forward ? array.next(a) : array.prev(a);
+        int d = forward ? array.next(c) : array.prev(c);
+        if(a == c || b == c || d == a)
+            continue;
+        array.flip(a, b, c, d);
+        list.flip(a, b, c, d);
+        if(!sameTour(array, list, gen)) {
+            cerr << "n = " << n << ": tours differ after flip " << f << " (" << a << ", " << b << ", " << c << ", "
+                 << d << ")" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    mt19937 gen(2021);
+    for(int n: {4, 5, 6, 7, 10, 16, 17, 64, 100, 257, 1000})
+        if(!testSize(n, 20 * n + 200, gen))
+            return 1;
+    cout << "TwoLevelListTour matches ArrayTour" << endl;
+    return 0;
+}